@@ -0,0 +1,172 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#pragma once
+#include "partition_def.h"
+#include <cstring>
+
+// Parallel parser for "u v" text edge lists (SNAP style).
+// The text is cut into newline-aligned chunks, one per core, and the
+// integers are decoded 8 bytes at a time with SWAR arithmetic.
+
+namespace EdgeParser{
+
+static const uint64_t ZEROS = 0x3030303030303030ull;
+
+inline uint64_t non_digit_mask(uint64_t w){
+    // A byte is zero iff it is an ASCII digit.
+    // The +6 may carry into later bytes only after a non-digit, which we never look past.
+    return ((w & 0xF0F0F0F0F0F0F0F0ull) | (((w + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) ^ 0x3333333333333333ull;
+}
+
+inline uint32_t eight_digits(uint64_t d){
+    // `d` holds 8 digit values, the most significant one in the lowest byte.
+    d = d * 10 + (d >> 8);
+    return (((d & 0x000000FF000000FFull) * (100 + (1000000ull << 32)))
+        + (((d >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+}
+
+inline const char * parse_uint(const char * p, const char * end, LL & x){
+    static const uint32_t POW10[9] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+    x = 0;
+    while(p + 8 <= end){
+        uint64_t w;
+        std::memcpy(&w, p, 8);
+        uint64_t nd = non_digit_mask(w);
+        if(!nd){
+            x = x * 100000000 + eight_digits(w - ZEROS);
+            p += 8;
+            continue;
+        }
+        int len = __builtin_ctzll(nd) / 8;
+        if(len){
+            // Move the digits to the top, so the bytes below become leading zeros.
+            // Borrows of the subtraction only run towards the bytes shifted out.
+            x = x * POW10[len] + eight_digits((w - ZEROS) << (8 * (8 - len)));
+        }
+        return p + len;
+    }
+    while(p < end && *p >= '0' && *p <= '9'){
+        x = x * 10 + (*p++ - '0');
+    }
+    return p;
+}
+
+inline const char * parse_int(const char * p, const char * end, LL & x, bool & ok){
+    bool neg = p < end && *p == '-';
+    if(neg){
+        p++;
+    }
+    const char * q = parse_uint(p, end, x);
+    ok = q != p;
+    if(neg){
+        x = -x;
+    }
+    return q;
+}
+
+inline const char * skip_blank(const char * p, const char * end){
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r')){
+        p++;
+    }
+    return p;
+}
+
+inline void parse_chunk(const char * p, const char * end, std::vector<Edge> & out){
+    while(p < end){
+        p = skip_blank(p, end);
+        LL u, v;
+        bool oku = false, okv = false;
+        if(p < end && *p != '#'){
+            p = parse_int(p, end, u, oku);
+            p = skip_blank(p, end);
+            p = parse_int(p, end, v, okv);
+        }
+        // Self-loops are dropped, comments and malformed lines are skipped.
+        if(oku && okv && u != v){
+            out.push_back(Edge{u, v});
+        }
+        const char * nl = (const char *)std::memchr(p, '\n', end - p);
+        p = nl ? nl + 1 : end;
+    }
+}
+
+// Smaller inputs are parsed on one thread.
+static const size_t PARALLEL_MIN = 1 << 20;
+
+inline std::vector<Edge> parse(const char * begin, const char * end, int threads, size_t parallel_min = PARALLEL_MIN){
+    // Returns the edges sorted and deduplicated, the same as a std::set<Edge>.
+    size_t len = end - begin;
+    if(threads < 1){
+        threads = 1;
+    }
+    if(len < parallel_min){
+        threads = 1;
+    }
+    std::vector<const char *> cut(threads + 1);
+    cut[0] = begin;
+    cut[threads] = end;
+    for(int i = 1; i < threads; i++){
+        const char * p = std::max(begin + len * i / threads, cut[i - 1]);
+        const char * nl = (const char *)std::memchr(p, '\n', end - p);
+        cut[i] = nl ? nl + 1 : end;
+    }
+
+    std::vector<std::vector<Edge>> part(threads);
+    std::vector<std::thread> ths;
+    for(int i = 0; i < threads; i++){
+        ths.emplace_back([&, i](){
+            part[i].reserve((cut[i + 1] - cut[i]) / 12);
+            parse_chunk(cut[i], cut[i + 1], part[i]);
+            std::sort(part[i].begin(), part[i].end());
+        });
+    }
+    for(auto && t: ths){
+        t.join();
+    }
+
+    std::vector<Edge> res;
+    std::vector<size_t> off(threads + 1, 0);
+    for(int i = 0; i < threads; i++){
+        off[i + 1] = off[i] + part[i].size();
+    }
+    res.reserve(off[threads]);
+    for(int i = 0; i < threads; i++){
+        res.insert(res.end(), part[i].begin(), part[i].end());
+        std::vector<Edge>().swap(part[i]);
+    }
+    // Merge the sorted runs pairwise, each round in parallel.
+    for(int step = 1; step < threads; step *= 2){
+        std::vector<std::thread> mths;
+        for(int i = 0; i + step < threads; i += 2 * step){
+            size_t l = off[i], m = off[i + step], r = off[std::min(i + 2 * step, threads)];
+            mths.emplace_back([&res, l, m, r](){
+                std::inplace_merge(res.begin() + l, res.begin() + m, res.begin() + r);
+            });
+        }
+        for(auto && t: mths){
+            t.join();
+        }
+    }
+    res.erase(std::unique(res.begin(), res.end()), res.end());
+    return res;
+}
+
+};
@@ -0,0 +1,208 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#pragma once
+#include "partition_def.h"
+#include "edge_parser.h"
+#include <string>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Binary edge list.
+// A header followed by `count` pairs of int64 (u, v) in host byte order,
+// with u < v, no self-loops, sorted and deduplicated.
+// So the edges can be handed out right from the mapping.
+static const char EDGE_FILE_MAGIC[8] = {'N', 'U', 'C', 'U', 'T', 'E', 'L', '\0'};
+static const uint32_t EDGE_FILE_VERSION = 1;
+
+struct EdgeFileHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t count;
+    // Keeps edges 16-byte aligned.
+    uint64_t reserved;
+};
+
+static_assert(sizeof(Edge) == 2 * sizeof(LL), "Edge must be layout compatible with the binary edge list");
+static_assert(sizeof(EdgeFileHeader) == 32, "Unexpected EdgeFileHeader layout");
+
+struct EdgeStore{
+    // Edges of the dataset, in dispensing order.
+    // Either owned, or mapped from a binary edge list without parsing.
+    std::vector<Edge> owned;
+    const Edge * mapped = nullptr;
+    size_t mapped_n = 0;
+    void * map = nullptr;
+    size_t map_len = 0;
+
+    EdgeStore(){
+    }
+    EdgeStore(const EdgeStore &) = delete;
+    EdgeStore & operator=(const EdgeStore &) = delete;
+    ~EdgeStore(){
+        unmap();
+    }
+
+    static bool is_binary(const std::string & path){
+        EdgeFileHeader h;
+        FILE * f = std::fopen(path.c_str(), "rb");
+        if(!f){
+            return false;
+        }
+        bool ok = std::fread(&h, sizeof h, 1, f) == 1 && std::memcmp(h.magic, EDGE_FILE_MAGIC, sizeof h.magic) == 0;
+        std::fclose(f);
+        return ok;
+    }
+
+    bool open_binary(const std::string & path){
+        unmap();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0){
+            return false;
+        }
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size < sizeof(EdgeFileHeader)){
+            ::close(fd);
+            return false;
+        }
+        void * m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(m == MAP_FAILED){
+            return false;
+        }
+        const EdgeFileHeader * h = (const EdgeFileHeader *)m;
+        if(std::memcmp(h->magic, EDGE_FILE_MAGIC, sizeof h->magic) != 0 || h->version != EDGE_FILE_VERSION
+                || sizeof(EdgeFileHeader) + h->count * sizeof(Edge) != st.st_size){
+            munmap(m, st.st_size);
+            return false;
+        }
+        madvise(m, st.st_size, MADV_SEQUENTIAL);
+        map = m;
+        map_len = st.st_size;
+        mapped = (const Edge *)((const char *)m + sizeof(EdgeFileHeader));
+        mapped_n = h->count;
+        return true;
+    }
+
+    bool load_text(const std::string & path, int threads = std::thread::hardware_concurrency()){
+        // Parsed on all cores, see EdgeParser.
+        unmap();
+        owned.clear();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0){
+            return false;
+        }
+        struct stat st;
+        if(fstat(fd, &st) != 0){
+            ::close(fd);
+            return false;
+        }
+        if(st.st_size == 0){
+            ::close(fd);
+            return true;
+        }
+        void * m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(m == MAP_FAILED){
+            return false;
+        }
+        madvise(m, st.st_size, MADV_SEQUENTIAL);
+        const char * text = (const char *)m;
+        owned = EdgeParser::parse(text, text + st.st_size, threads);
+        munmap(m, st.st_size);
+        return true;
+    }
+
+    bool load(const std::string & path){
+        // Binary edge lists are mapped, anything else is parsed as "u v" lines.
+        if(is_binary(path)){
+            return open_binary(path);
+        }
+        return load_text(path);
+    }
+
+    bool write_binary(const std::string & path) const{
+        FILE * f = std::fopen(path.c_str(), "wb");
+        if(!f){
+            return false;
+        }
+        EdgeFileHeader h;
+        std::memcpy(h.magic, EDGE_FILE_MAGIC, sizeof h.magic);
+        h.version = EDGE_FILE_VERSION;
+        h.flags = 0;
+        h.count = size();
+        h.reserved = 0;
+        bool ok = std::fwrite(&h, sizeof h, 1, f) == 1;
+        ok = ok && std::fwrite(begin(), sizeof(Edge), size(), f) == size();
+        ok = (std::fclose(f) == 0) && ok;
+        return ok;
+    }
+
+    bool write_text(const std::string & path) const{
+        // "u v" lines, readable by load_text.
+        FILE * f = std::fopen(path.c_str(), "w");
+        if(!f){
+            return false;
+        }
+        bool ok = true;
+        for(const Edge & e: *this){
+            ok = ok && std::fprintf(f, "%lld %lld\n", e.u, e.v) > 0;
+        }
+        ok = (std::fclose(f) == 0) && ok;
+        return ok;
+    }
+
+    void push_back(const Edge & e){
+        assert(!mapped);
+        owned.push_back(e);
+    }
+    bool is_mapped() const{
+        return mapped != nullptr;
+    }
+    size_t size() const{
+        return mapped ? mapped_n : owned.size();
+    }
+    const Edge * begin() const{
+        return mapped ? mapped : owned.data();
+    }
+    const Edge * end() const{
+        return begin() + size();
+    }
+    const Edge & operator[](size_t i) const{
+        return begin()[i];
+    }
+    std::set<Edge> to_set() const{
+        return std::set<Edge>(begin(), end());
+    }
+
+    void unmap(){
+        if(map){
+            munmap(map, map_len);
+        }
+        map = nullptr;
+        map_len = 0;
+        mapped = nullptr;
+        mapped_n = 0;
+    }
+};
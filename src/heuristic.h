@@ -20,124 +20,109 @@
 
 #pragma once
 #include "partition.h"
+#include "score_kernel.h"
 
-inline std::vector<double> evaluate_partition_greedy(const Vertex & u, const Vertex & v, const std::vector<Partition> & parts){
-    int max_size = std::max_element(parts.begin(), parts.end(), [](const Partition & p1, const Partition & p2){ return p1.edges.size() < p2.edges.size();})->edges.size();
-    int min_size = std::min_element(parts.begin(), parts.end(), [](const Partition & p1, const Partition & p2){ return p1.edges.size() < p2.edges.size();})->edges.size();
-    int n = parts.size();
-    printf("In all %u parts: max_size %u, min_size %u\n", parts.size(), max_size, min_size);
+inline ScoreParams params_greedy(const Vertex & u, const Vertex & v, const PartitionLoads & loads){
+    int max_size = loads.max();
+    int min_size = loads.min();
+    LOG_TRACE("In all %zu parts: max_size %u, min_size %u\n", loads.size(), max_size, min_size);
     assert(u.deg.load() > 0);
     assert(v.deg.load() > 0);
-    double d1 = u.deg.load(), d2 = v.deg.load();
-
-    double epsilon = 1.0;
-    double lambda = 1.0;
-
-    auto compute_replication_score = [&](P p) -> double {
-        double sr = 0.0;
-        if(u.parts.find(p) != u.parts.end()){
-            sr += 1;
-        }
-        if(v.parts.find(p) != v.parts.end()){
-            sr += 1;
-        }
-        return sr;
-    };
-
-    auto compute_balance_score = [&](P p) -> double {
-        int es = parts[p].edges.size();
-        // es++, score--
-        return lambda * (max_size - es) / (epsilon + max_size - min_size);
-    };
-
-    std::vector<double> ans;
-    ans.resize(n);
-
-    for(P i = 0; i < n; i++){
-        double rep_score = compute_replication_score(i);
-        double bal_score = compute_balance_score(i);
-        double score = rep_score + bal_score;
-        // printf("score[%d] = %lf + %lf = %lf\n", i, rep_score, bal_score, score);
-        ans[i] = score;
-    }
 
-    return ans;
+    ScoreParams sp;
+    sp.epsilon = 1.0;
+    sp.lambda = 1.0;
+    // Replication score is 1 for each of u and v already in the partition.
+    sp.wu = 1.0;
+    sp.wv = 1.0;
+    sp.max_size = max_size;
+    sp.min_size = min_size;
+    return sp;
 }
 
-
-inline std::vector<double> evaluate_partition_hdrf(const Vertex & u, const Vertex & v, const std::vector<Partition> & parts){
+inline ScoreParams params_hdrf(const Vertex & u, const Vertex & v, const PartitionLoads & loads){
     // Use heuristic to predict.
     // HDRF
-    int max_size = std::max_element(parts.begin(), parts.end(), [](const Partition & p1, const Partition & p2){ return p1.edges.size() < p2.edges.size();})->edges.size();
-    int min_size = std::min_element(parts.begin(), parts.end(), [](const Partition & p1, const Partition & p2){ return p1.edges.size() < p2.edges.size();})->edges.size();
-    int n = parts.size();
-    printf("In all %u parts: max_size %u, min_size %u\n", parts.size(), max_size, min_size);
+    int max_size = loads.max();
+    int min_size = loads.min();
+    LOG_TRACE("In all %zu parts: max_size %u, min_size %u\n", loads.size(), max_size, min_size);
     assert(u.deg.load() > 0);
     assert(v.deg.load() > 0);
     double d1 = u.deg.load(), d2 = v.deg.load();
 
-    double lambda = 1.0;
-    double epsilon = 1.0;
     double theta1 = d1 / (d1 + d2);
     double theta2 = 1 - theta1;
 
-    auto g = [&](P p, Vertex x, double theta) -> double {
-        if(x.parts.find(p) == x.parts.end()){
-            return 0;
-        }
-        return 1 + (1 - theta);
-    };
-
-    auto compute_replication_score = [&](P p) -> double {
-        return g(p, u, theta1) + g(p, v, theta2);
-    };
-
-    auto compute_balance_score = [&](P p) -> double {
-        int es = parts[p].edges.size();
-        return lambda * (max_size - es) / (epsilon + max_size - min_size);
-    };
-
-    std::vector<double> ans;
-    ans.resize(n);
-
-    for(P i = 0; i < n; i++){
-        double rep_score = compute_replication_score(i);
-        double bal_score = compute_balance_score(i);
-        double score = rep_score + bal_score;
-        // printf("score[%d] = %lf + %lf = %lf\n", i, rep_score, bal_score, score);
-        ans[i] = score;
-    }
+    ScoreParams sp;
+    sp.lambda = 1.0;
+    sp.epsilon = 1.0;
+    // g(p, x, theta) is 1 + (1 - theta) if x is already in p.
+    sp.wu = 1 + (1 - theta1);
+    sp.wv = 1 + (1 - theta2);
+    sp.max_size = max_size;
+    sp.min_size = min_size;
+    return sp;
+}
+
+inline ScoreParams params_mixed(const Vertex & u, const Vertex & v, const PartitionLoads & loads){
+    // Mean of HDRF and greedy, which share the balance score.
+    ScoreParams h = params_hdrf(u, v, loads);
+    ScoreParams g = params_greedy(u, v, loads);
+    ScoreParams sp = h;
+    sp.wu = (h.wu + g.wu) / 2.0;
+    sp.wv = (h.wv + g.wv) / 2.0;
+    return sp;
+}
+
+inline std::vector<double> evaluate_partition_greedy(const Vertex & u, const Vertex & v, const PartitionLoads & loads){
+    return score_partitions(params_greedy(u, v, loads), loads.load.data(), u.parts, v.parts, loads.size());
+}
 
-    return ans;
+inline std::vector<double> evaluate_partition_hdrf(const Vertex & u, const Vertex & v, const PartitionLoads & loads){
+    return score_partitions(params_hdrf(u, v, loads), loads.load.data(), u.parts, v.parts, loads.size());
 }
 
-template<typename F>
-inline P select_partition_with(F f, const Vertex & u, const Vertex & v, const std::vector<Partition> & parts){
-    auto ans = f(u, v, parts);
-    int max_part = std::max_element(ans.begin(), ans.end(), std::less<double>()) - ans.begin();
-    printf("max_part %d\n", max_part);
+inline P select_partition_with_params(const ScoreParams & sp, const Vertex & u, const Vertex & v, const PartitionLoads & loads){
+    // Scores all partitions with the vectorized kernel, see score_kernel.h.
+    P max_part = score_argmax(sp, loads.load.data(), u.parts, v.parts, loads.size());
+    LOG_TRACE("max_part %lld\n", max_part);
     return max_part;
 }
 
-inline P select_partition_with_hrdf(const Vertex & u, const Vertex & v, const std::vector<Partition> & parts){
-    return select_partition_with(evaluate_partition_hdrf, u, v, parts);
+inline P select_partition_with_hrdf(const Vertex & u, const Vertex & v, const PartitionLoads & loads){
+    return select_partition_with_params(params_hdrf(u, v, loads), u, v, loads);
 }
 
-inline P select_partition_with_greedy(const Vertex & u, const Vertex & v, const std::vector<Partition> & parts){
-    return select_partition_with(evaluate_partition_greedy, u, v, parts);
+inline P select_partition_with_greedy(const Vertex & u, const Vertex & v, const PartitionLoads & loads){
+    return select_partition_with_params(params_greedy(u, v, loads), u, v, loads);
 }
 
-inline P select_partition_with_mixed(const Vertex & u, const Vertex & v, const std::vector<Partition> & parts){
-    auto ans1 = evaluate_partition_hdrf(u, v, parts);
-    auto ans2 = evaluate_partition_greedy(u, v, parts);
-    int n = ans1.size();
+inline P select_partition_with_mixed(const Vertex & u, const Vertex & v, const PartitionLoads & loads){
+    return select_partition_with_params(params_mixed(u, v, loads), u, v, loads);
+}
 
-    std::vector<double> ans;
-    ans.resize(n);
-    for(int i = 0; i < n; i++){
-        ans[i] = (ans2[i] + ans1[i]) / 2.0;
+struct GreedyHeuristic{
+    static P select(const PartitionConfig & config, const Vertex & u, const Vertex & v, const PartitionLoads & loads){
+        return select_partition_with_greedy(u, v, loads);
     }
-    int max_part = std::max_element(ans.begin(), ans.end(), std::less<double>()) - ans.begin();
-    printf("max_part %d\n", max_part);
-    return max_part;
-}
\ No newline at end of file
+};
+
+struct HdrfHeuristic{
+    static P select(const PartitionConfig & config, const Vertex & u, const Vertex & v, const PartitionLoads & loads){
+        return select_partition_with_hrdf(u, v, loads);
+    }
+};
+
+struct MixedHeuristic{
+    static P select(const PartitionConfig & config, const Vertex & u, const Vertex & v, const PartitionLoads & loads){
+        return select_partition_with_mixed(u, v, loads);
+    }
+};
+
+// Turns a user function into a policy, e.g. `MajorPartitioner<UserHeuristic<my_select>>`.
+template<P (*F)(const Vertex & u, const Vertex & v, const PartitionLoads & loads)>
+struct UserHeuristic{
+    static P select(const PartitionConfig & config, const Vertex & u, const Vertex & v, const PartitionLoads & loads){
+        return F(u, v, loads);
+    }
+};
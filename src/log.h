@@ -0,0 +1,175 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#pragma once
+#include <cstdio>
+#include <cstdarg>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+
+// Logging with compile-time levels.
+// Calls below NUCUT_LOG_LEVEL expand to nothing, arguments included.
+// TRACE is per edge, DEBUG is per window, INFO is per run.
+#define NUCUT_LOG_TRACE 0
+#define NUCUT_LOG_DEBUG 1
+#define NUCUT_LOG_INFO 2
+#define NUCUT_LOG_WARN 3
+#define NUCUT_LOG_ERROR 4
+#define NUCUT_LOG_NONE 5
+
+#if !defined(NUCUT_LOG_LEVEL)
+#if defined(_HIDE_DEBUG)
+#define NUCUT_LOG_LEVEL NUCUT_LOG_INFO
+#else
+#define NUCUT_LOG_LEVEL NUCUT_LOG_DEBUG
+#endif
+#endif
+
+struct LogSink{
+    // Kept messages go through a bounded MPSC ring, and a background thread writes them out,
+    // so logging threads never wait on stdout.
+    // Define NUCUT_LOG_SYNC to print in place, e.g. when chasing a crash.
+    static const size_t SLOTS = 4096;
+    static const size_t SLOT_SIZE = 240;
+    struct Slot{
+        std::atomic<size_t> seq;
+        int len;
+        char msg[SLOT_SIZE];
+    };
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<size_t> head{0};
+    size_t tail = 0;
+    std::atomic<bool> stop{false};
+    std::thread * th;
+    FILE * out;
+
+    LogSink(FILE * o = stdout) : out(o){
+        slots.reset(new Slot[SLOTS]);
+        for(size_t i = 0; i < SLOTS; i++){
+            slots[i].seq.store(i);
+        }
+        th = new std::thread(&LogSink::main_proc, this);
+    }
+    ~LogSink(){
+        stop.store(true);
+        th->join();
+        delete th;
+    }
+
+    void push(const char * fmt, va_list ap){
+        size_t pos = head.fetch_add(1);
+        Slot & s = slots[pos % SLOTS];
+        // Wait until the writer is done with the previous lap of this slot.
+        while(s.seq.load(std::memory_order_acquire) != pos){
+            std::this_thread::yield();
+        }
+        int n = vsnprintf(s.msg, SLOT_SIZE, fmt, ap);
+        s.len = n < 0 ? 0 : std::min<int>(n, SLOT_SIZE - 1);
+        s.seq.store(pos + 1, std::memory_order_release);
+    }
+
+    bool drain(){
+        bool any = false;
+        while(1){
+            Slot & s = slots[tail % SLOTS];
+            if(s.seq.load(std::memory_order_acquire) != tail + 1){
+                break;
+            }
+            fwrite(s.msg, 1, s.len, out);
+            s.seq.store(tail + SLOTS, std::memory_order_release);
+            tail++;
+            any = true;
+        }
+        return any;
+    }
+
+    void main_proc(){
+        using namespace std::chrono_literals;
+        while(!stop.load()){
+            if(!drain()){
+                fflush(out);
+                std::this_thread::sleep_for(1ms);
+            }
+        }
+        // Everything claimed before stop is written.
+        while(tail != head.load()){
+            if(!drain()){
+                std::this_thread::yield();
+            }
+        }
+        fflush(out);
+    }
+};
+
+inline LogSink & log_sink(){
+    static LogSink sink;
+    return sink;
+}
+
+// Checked like printf, calls compiled out below the level are not.
+__attribute__((format(printf, 1, 2)))
+inline void nucut_log(const char * fmt, ...){
+    va_list ap;
+    va_start(ap, fmt);
+    #if defined(NUCUT_LOG_SYNC)
+    vprintf(fmt, ap);
+    #else
+    log_sink().push(fmt, ap);
+    #endif
+    va_end(ap);
+}
+
+#if NUCUT_LOG_LEVEL <= NUCUT_LOG_TRACE
+#define LOG_TRACE(...) nucut_log(__VA_ARGS__)
+#else
+#define LOG_TRACE(...) do{}while(0)
+#endif
+
+#if NUCUT_LOG_LEVEL <= NUCUT_LOG_DEBUG
+#define LOG_DEBUG(...) nucut_log(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do{}while(0)
+#endif
+
+#if NUCUT_LOG_LEVEL <= NUCUT_LOG_INFO
+#define LOG_INFO(...) nucut_log(__VA_ARGS__)
+#else
+#define LOG_INFO(...) do{}while(0)
+#endif
+
+#if NUCUT_LOG_LEVEL <= NUCUT_LOG_WARN
+#define LOG_WARN(...) nucut_log(__VA_ARGS__)
+#else
+#define LOG_WARN(...) do{}while(0)
+#endif
+
+#if NUCUT_LOG_LEVEL <= NUCUT_LOG_ERROR
+#define LOG_ERROR(...) nucut_log(__VA_ARGS__)
+#else
+#define LOG_ERROR(...) do{}while(0)
+#endif
+
+// For errors the run can't go on from, whatever the level and NDEBUG.
+// Written straight to stderr, since the sink would not get to it before abort().
+#define LOG_FATAL(...) do{ std::fprintf(stderr, __VA_ARGS__); std::abort(); }while(0)
@@ -21,6 +21,7 @@
 #pragma once
 #include "partition_def.h"
 
+template<typename H>
 struct Subpartitioner{
     PartitionConfig config;
     std::thread * ths;
@@ -33,39 +34,37 @@ struct Subpartitioner{
     }
 
     void main_proc(){
-        bool valid = false;
-        Set<Edge> window;
+        std::vector<Edge> window;
         Set<V> vs;
+        window.reserve(config.window);
         while(1){
-            Edge e = config.state->get_edge(valid);
-            if(!valid){
+            // A whole window is dispensed at once.
+            if(!config.state->get_edges(config.window, window)){
                 // No edges
                 break;
             }
-            window.insert(e);
-            vs.insert(e.u);
-            vs.insert(e.v);
-            if(window.size() % config.window == 0){
-                partition_with_window(window, vs);
-                window.clear();
-                vs.clear();
+            for(const Edge & e: window){
+                vs.insert(e.u);
+                vs.insert(e.v);
             }
-        }
-        if(window.size()){
             partition_with_window(window, vs);
             window.clear();
             vs.clear();
         }
-        printf("Thread Finished.\n");
+        LOG_INFO("Thread Finished.\n");
     }
 
-    void partition_with_window(const Set<Edge> & window, const Set<V> & vs){
+    void partition_with_window(const std::vector<Edge> & window, const Set<V> & vs){
         // NOTICE We should fetch a copy rather than a reference. To avoid sync problems.
         uint64_t start_time = get_current_ms();
         Map<V, Vertex> verts = config.state->get_verts(vs);
-        std::vector<Partition> parts = config.state->get_parts();
+        // Only the live loads are needed to score, partitions themselves are not copied.
+        PartitionLoads loads = config.state->get_loads();
+        // Partitions are append-only, so only edges of this window are merged back.
+        std::vector<Partition> delta;
+        delta.resize(loads.size());
 
-        printf("vs.size() = %u, parts.size() = %u.\n", vs.size(), parts.size());
+        LOG_DEBUG("vs.size() = %zu, parts.size() = %zu.\n", vs.size(), loads.size());
         for(const Edge & e: window){
             Vertex & u = verts[e.u];
             Vertex & v = verts[e.v];
@@ -74,26 +73,29 @@ struct Subpartitioner{
             u.delta_deg++;
             v.delta_deg++;
 
-            printf("Select partition Edge{%lld, %lld}\n", e.u, e.v);
-            P p = config.hf(u, v, parts);
+            LOG_TRACE("Select partition Edge{%lld, %lld}\n", e.u, e.v);
+            P p = H::select(config, u, v, loads);
             assert(p != -1);
             // If u/v is already related to p, the following stmt changes nothing.
             u.add_part(p);
             v.add_part(p);
             // If e is already related to p, the following stmt changes nothing
-            printf("Assign Edge{%lld, %lld} to %lld. Prev size %u\n", e.u, e.v, p, parts[p].edges.size());
-            parts[p].add_edge(e);
+            LOG_TRACE("Assign Edge{%lld, %lld} to %lld. Prev size %lld\n", e.u, e.v, p, loads[p]);
+            loads.add(p);
+            delta[p].add_edge(e);
         }
         // Merge results
-        // NOTICE All the changes made(verts and parts) are idempotent,
+        // NOTICE Changes to verts are idempotent, while delta holds only new edges,
         // We can just simply merge them.
         config.state->put_verts(verts);
-        config.state->put_parts(parts);
+        config.state->put_parts(delta);
         uint64_t end_time = get_current_ms();
         #if defined(COMPUTE_OVERHEAD)
+            // pk is the size of every partition after this window, as it was when whole
+            // partitions were copied back, so the overhead figures stay comparable.
             int pk = 0;
-            for(P i = 0; i < parts.size(); i++){
-                pk += parts[i].edges.size();
+            for(P i = 0; i < loads.size(); i++){
+                pk += loads[i];
                 config.ds->total_e.fetch_add(pk);
             }
             config.ds->useful_e.fetch_add(window.size());
@@ -151,16 +153,7 @@ public:
         }
         for (auto && e: all_edges)
         {
-            bool ex = false;
-            for(int i = 0; i < config.k; i++){
-                if(parts[i].edges.find(e) == parts[i].edges.end()){
-                    continue;
-                }else{
-                    ex = true;
-                    break;
-                }
-            }
-            if(!ex){
+            if(edges_loc.find(e) == edges_loc.end()){
                 printf("Missing edge [%lld, %lld]\n", e.u, e.v);
                 fprintf(config.ds->f, "Missing edge [%lld, %lld]\n", e.u, e.v);
             }
@@ -191,8 +184,9 @@ public:
     virtual void join() = 0;
 };
 
+template<typename H>
 struct MajorPartitioner : public MajorPartitionerBase{
-    Subpartitioner * subs;
+    Subpartitioner<H> * subs;
 
     ~MajorPartitioner(){
         delete [] subs;
@@ -202,11 +196,11 @@ struct MajorPartitioner : public MajorPartitionerBase{
     virtual void run() override{
         this->config.ds->total_e.store(0);
         this->config.ds->useful_e.store(0);
-        subs = new Subpartitioner[this->config.subp];
+        subs = new Subpartitioner<H>[this->config.subp];
         for(int i = 0; i < this->config.subp; i++){
             subs[i].config = this->config;
         }
-        printf("Run\n");
+        LOG_INFO("Run\n");
         for(int i = 0; i < this->config.subp; i++){
             subs[i].run();
         }
@@ -215,7 +209,7 @@ struct MajorPartitioner : public MajorPartitionerBase{
         for(int i = 0; i < this->config.subp; i++){
             subs[i].join();
         }
-        printf("total_e %d, useful_e %d\n", this->config.ds->total_e.load(), this->config.ds->useful_e.load());
+        LOG_INFO("total_e %d, useful_e %d\n", this->config.ds->total_e.load(), this->config.ds->useful_e.load());
     }
 };
 
@@ -20,12 +20,46 @@
 
 #pragma once
 #include "partition.h"
+#include "spsc_ring.h"
 
+struct CommitSignal{
+    // Wakes the committer when a subpartitioner has output ready, or on stop.
+    std::mutex mut;
+    std::condition_variable cv;
+    bool pending = false;
+    bool stop = false;
+
+    void notify(){
+        {
+            std::lock_guard<std::mutex> guard((mut));
+            pending = true;
+        }
+        cv.notify_one();
+    }
+    void finish(){
+        {
+            std::lock_guard<std::mutex> guard((mut));
+            stop = true;
+        }
+        cv.notify_one();
+    }
+    // Sleeps until notified or the deadline passes. Returns true once stopped.
+    bool wait(std::chrono::milliseconds deadline){
+        std::unique_lock<std::mutex> lk((mut));
+        cv.wait_for(lk, deadline, [this](){ return pending || stop; });
+        pending = false;
+        return stop;
+    }
+};
+
+template<typename H>
 struct SubpartitionerAsync{
     PartitionConfig config;
     std::thread * ths;
-    std::vector<Partition> parts;
-    std::queue<std::pair<P, Edge>> out_queue;
+    PartitionLoads loads;
+    // Assignments on their way to the drain thread, see MajorPartitionerAsync.
+    SpscRing<std::pair<P, Edge>> out_queue;
+    CommitSignal * signal;
     int acc_window = -1;
     int acc_window_thres_factor = 5;
 
@@ -37,43 +71,37 @@ struct SubpartitionerAsync{
     }
 
     void main_proc(){
-        bool valid = false;
-        Set<Edge> window;
+        std::vector<Edge> window;
         Set<V> vs;
+        window.reserve(config.window);
         while(1){
-            Edge e = config.state->get_edge(valid);
-            if(!valid){
+            // A whole window is dispensed at once.
+            if(!config.state->get_edges(config.window, window)){
                 // No edges
                 break;
             }
-            window.insert(e);
-            vs.insert(e.u);
-            vs.insert(e.v);
-            if(window.size() % config.window == 0){
-                partition_with_window(window, vs);
-                window.clear();
-                vs.clear();
+            for(const Edge & e: window){
+                vs.insert(e.u);
+                vs.insert(e.v);
             }
-        }
-        if(window.size()){
             partition_with_window(window, vs);
             window.clear();
             vs.clear();
         }
-        printf("Thread Finished.\n");
+        LOG_INFO("Thread Finished.\n");
     }
 
-    void partition_with_window(const Set<Edge> & window, const Set<V> & vs){
+    void partition_with_window(const std::vector<Edge> & window, const Set<V> & vs){
         // NOTICE We should fetch a copy rather than a reference. To avoid sync problems.
         Map<V, Vertex> verts = config.state->get_verts(vs);
         if(acc_window == -1 || acc_window % acc_window_thres_factor == 0){
             acc_window = 0;
-            parts = config.state->get_parts();
+            loads = config.state->get_loads();
         }
         acc_window++;
 
         uint64_t start_time = get_current_ms();
-        printf("vs.size() = %u, parts.size() = %u.\n", vs.size(), parts.size());
+        LOG_DEBUG("vs.size() = %zu, parts.size() = %zu.\n", vs.size(), loads.size());
         for(const Edge & e: window){
             Vertex & u = verts[e.u];
             Vertex & v = verts[e.v];
@@ -82,31 +110,35 @@ struct SubpartitionerAsync{
             u.delta_deg++;
             v.delta_deg++;
 
-            printf("---\nSelect partition Edge{%lld, %lld}\n", e.u, e.v);
-            P p = config.hf(u, v, parts);
+            LOG_TRACE("---\nSelect partition Edge{%lld, %lld}\n", e.u, e.v);
+            P p = H::select(config, u, v, loads);
             assert(p != -1);
             // If u/v is already related to p, the following stmt changes nothing.
             u.add_part(p);
             v.add_part(p);
             // If e is already related to p, the following stmt changes nothing
             config.state->check_crashed();
-            printf("Assign Edge{%lld, %lld} to %lld. Prev size %u\n", e.u, e.v, p, parts[p].edges.size());
-            parts[p].add_edge(e);
-            out_queue.push(std::make_pair(p, e));
+            LOG_TRACE("Assign Edge{%lld, %lld} to %lld. Prev size %lld\n", e.u, e.v, p, loads[p]);
+            loads.add(p);
+            if(!out_queue.try_push(std::make_pair(p, e))){
+                // Full, wake the committer and wait for room.
+                signal->notify();
+                out_queue.push(std::make_pair(p, e));
+            }
         }
         // Merge results
         // NOTICE All the changes made(verts and parts) are idempotent,
         // We can just simply merge them.
         config.state->put_verts(verts);
-        // We do not put_parts
-        // config.state->put_parts(parts);
+        // We do not put_parts, the committer does.
+        signal->notify();
         uint64_t end_time = get_current_ms();
         #if defined(COMPUTE_OVERHEAD)
         fprintf(config.ds->f, "%d %d %llu\n", -1, window.size(), end_time - start_time);
         update_max(config.ds->max_t, end_time - start_time);
         update_min(config.ds->min_t, end_time - start_time);
         #endif
-        printf("partition_with_window end.\n");
+        LOG_DEBUG("partition_with_window end.\n");
     }
 
     void run(){
@@ -121,55 +153,60 @@ struct SubpartitionerAsync{
 
 };
 
+template<typename H>
 struct MajorPartitionerAsync : public MajorPartitionerBase{
-    SubpartitionerAsync * subs;
-    std::vector<std::thread *> thsq;
-    // std::thread * tq;
-    bool stop = false;
+    SubpartitionerAsync<H> * subs;
+    // A single committer drains every subpartitioner's ring.
+    // It sleeps until a window ends (or a ring fills up) or the flush deadline passes,
+    // then commits what all of them produced with one put_parts.
+    std::thread * tc = nullptr;
+    CommitSignal signal;
+    static const size_t DRAIN_BATCH = 4096;
 
     ~MajorPartitionerAsync(){
         delete [] subs;
     }
     MajorPartitionerAsync(PartitionConfig c): MajorPartitionerBase(c){
     }
+    void commit_proc(){
+        std::vector<Partition> dp;
+        dp.resize(this->config.k);
+        std::vector<P> dirty;
+        bool last = false;
+        do{
+            // Subpartitioners are joined before stop is set, so the pass
+            // after seeing stop collects everything left.
+            last = signal.wait(std::chrono::milliseconds(this->config.flush_ms));
+            for(int cid = 0; cid < this->config.subp; cid++){
+                while(subs[cid].out_queue.drain(DRAIN_BATCH, [&](const std::pair<P, Edge> & pr){
+                    if(dp[pr.first].edges.empty()){
+                        dirty.push_back(pr.first);
+                    }
+                    dp[pr.first].add_edge(pr.second);
+                }) == DRAIN_BATCH){
+                }
+            }
+            if(dirty.empty()){
+                continue;
+            }
+            this->config.state->check_crashed();
+            this->config.state->put_parts(dp);
+            // Only the partitions touched in this pass need resetting.
+            for(P p: dirty){
+                dp[p].edges.clear();
+            }
+            dirty.clear();
+        } while(!last);
+    }
     virtual void run() override{
-        subs = new SubpartitionerAsync[this->config.subp];
-        thsq.resize(this->config.subp);
+        subs = new SubpartitionerAsync<H>[this->config.subp];
         for(int i = 0; i < this->config.subp; i++){
             subs[i].config = this->config;
+            subs[i].signal = &signal;
+            subs[i].out_queue.init(this->config.out_ring);
         }
-        for(int i = 0; i < this->config.subp; i++){
-            assert(i < this->config.subp);
-            thsq[i] = new std::thread([this, cid=i, subs=subs](){
-                do{
-                    std::vector<Partition> dp;
-                    dp.resize(this->config.k);
-                    while(subs[cid].out_queue.size()){
-                        std::pair<P, Edge> pr = subs[cid].out_queue.front();
-                        subs[cid].out_queue.pop();
-                        // NOTICE Need protect??
-                        dp[pr.first].add_edge(pr.second);
-                    }
-                    this->config.state->check_crashed();
-                    this->config.state->put_parts(dp);
-                } while(!stop);
-            });
-        }
-        // tq = new std::thread([this, subs=subs](){
-        //     do{
-        //         std::vector<Partition> dp;
-        //         dp.resize(this->config.k);
-        //         for(int cid = 0; cid < this->config.subp; cid++){
-        //             while(subs[cid].out_queue.size()){
-        //                 std::pair<P, Edge> pr = subs[cid].out_queue.front();
-        //                 subs[cid].out_queue.pop();
-        //                 dp[pr.first].add_edge(pr.second);
-        //             }
-        //         }
-        //         this->config.state->put_parts(dp);
-        //     } while(!stop);
-        // });
-        printf("Run\n");
+        tc = new std::thread(&MajorPartitionerAsync::commit_proc, this);
+        LOG_INFO("Run\n");
         for(int i = 0; i < this->config.subp; i++){
             subs[i].run();
         }
@@ -178,17 +215,13 @@ struct MajorPartitionerAsync : public MajorPartitionerBase{
         for(int i = 0; i < this->config.subp; i++){
             subs[i].join();
         }
-        stop = true;
-        for(auto && t: thsq){
-            if(t->joinable()){
-                t->join();
+        signal.finish();
+        if(tc){
+            if(tc->joinable()){
+                tc->join();
             }
-            delete t;
+            delete tc;
+            tc = nullptr;
         }
-        thsq.clear();
-        // if(tq->joinable()){
-        //     tq->join();
-        // }
-        // delete tq;
     }
-};
\ No newline at end of file
+};
@@ -37,6 +37,9 @@
 #include <cmath>
 #include <condition_variable>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include "log.h"
 
 #define COMPUTE_OVERHEAD
 
@@ -44,6 +47,7 @@ typedef long long LL;
 typedef LL E; // Index for edge
 typedef LL V; // Index for vertex
 typedef LL P; // Index for partition
+typedef uint32_t VI; // Dense internal index for vertex
 template <typename K, typename V>
 using Map = std::map<K, V>;
 template <typename T>
@@ -57,13 +61,142 @@ inline uint64_t get_current_ms(){
     return (uint64_t)timestamp;  
 }
 
+struct VertexDict{
+    // Turns raw vertex ids into dense indices, in the order they are first seen.
+    std::unordered_map<V, VI> index;
+    std::vector<V> raw;
+
+    VI intern(V v){
+        auto it = index.find(v);
+        if(it != index.end()){
+            return it->second;
+        }
+        assert(raw.size() < std::numeric_limits<VI>::max());
+        VI i = raw.size();
+        index.emplace(v, i);
+        raw.push_back(v);
+        return i;
+    }
+    bool find(V v, VI & i) const{
+        auto it = index.find(v);
+        if(it == index.end()){
+            return false;
+        }
+        i = it->second;
+        return true;
+    }
+    V to_raw(VI i) const{
+        return raw[i];
+    }
+    size_t size() const{
+        return raw.size();
+    }
+    void clear(){
+        index.clear();
+        raw.clear();
+    }
+};
+
+struct PartSet{
+    // Partition membership as a bitmask.
+    // Partitions below 64 live in `inl`, larger k spills into `ext`.
+    uint64_t inl = 0;
+    std::vector<uint64_t> ext;
+
+    struct iterator{
+        const PartSet * s;
+        size_t w;
+        uint64_t cur;
+        iterator(const PartSet * ss, size_t ww) : s(ss), w(ww), cur(0){
+            if(w < s->words()){
+                cur = s->word(w);
+                skip();
+            }
+        }
+        void skip(){
+            while(!cur && ++w < s->words()){
+                cur = s->word(w);
+            }
+        }
+        P operator*() const{
+            return w * 64 + __builtin_ctzll(cur);
+        }
+        iterator & operator++(){
+            cur &= cur - 1;
+            skip();
+            return *this;
+        }
+        bool operator!=(const iterator & r) const{
+            return w != r.w || cur != r.cur;
+        }
+    };
+
+    size_t words() const{
+        return 1 + ext.size();
+    }
+    uint64_t word(size_t w) const{
+        return w == 0 ? inl : ext[w - 1];
+    }
+    uint64_t bits(size_t w) const{
+        // Like word(), but partitions past the last word are simply absent.
+        return w < words() ? word(w) : 0;
+    }
+    void insert(P p){
+        if(p < 64){
+            inl |= 1ull << p;
+            return;
+        }
+        size_t w = p / 64;
+        if(ext.size() < w){
+            ext.resize(w, 0);
+        }
+        ext[w - 1] |= 1ull << (p % 64);
+    }
+    bool contains(P p) const{
+        size_t w = p / 64;
+        if(w >= words()){
+            return false;
+        }
+        return (word(w) >> (p % 64)) & 1;
+    }
+    void merge(const PartSet & r){
+        inl |= r.inl;
+        if(ext.size() < r.ext.size()){
+            ext.resize(r.ext.size(), 0);
+        }
+        for(size_t i = 0; i < r.ext.size(); i++){
+            ext[i] |= r.ext[i];
+        }
+    }
+    size_t size() const{
+        size_t n = __builtin_popcountll(inl);
+        for(uint64_t x: ext){
+            n += __builtin_popcountll(x);
+        }
+        return n;
+    }
+    bool empty() const{
+        return size() == 0;
+    }
+    void clear(){
+        inl = 0;
+        ext.clear();
+    }
+    iterator begin() const{
+        return iterator(this, 0);
+    }
+    iterator end() const{
+        return iterator(this, words());
+    }
+};
+
 struct Vertex{
     std::atomic<int> deg;
     // Use to sync with shared state by delta
     int delta_deg;
     // TODO Need protecting.
     // All partitions which related to me.
-    Set<P> parts;
+    PartSet parts;
 
     void add_part(P p){
         // Add a partition that related to me.
@@ -114,10 +247,76 @@ struct Edge{
     }
 };
 
+struct EdgeHash{
+    size_t operator()(const Edge & e) const{
+        return (size_t)e.u * 0x9E3779B97F4A7C15ull ^ (size_t)e.v;
+    }
+};
+
+struct EdgeColumns{
+    // Append-only edge storage, kept as chunked u/v columns.
+    // Chunks never move once allocated, so appending is O(1).
+    static const size_t CHUNK = 4096;
+    std::vector<std::vector<V>> cu;
+    std::vector<std::vector<V>> cv;
+    size_t n = 0;
+
+    struct iterator{
+        const EdgeColumns * c;
+        size_t i;
+        Edge operator*() const{
+            return (*c)[i];
+        }
+        iterator & operator++(){
+            i++;
+            return *this;
+        }
+        bool operator!=(const iterator & r) const{
+            return i != r.i;
+        }
+    };
+
+    void push_back(const Edge & e){
+        if(n % CHUNK == 0){
+            cu.emplace_back();
+            cv.emplace_back();
+            cu.back().reserve(CHUNK);
+            cv.back().reserve(CHUNK);
+        }
+        cu.back().push_back(e.u);
+        cv.back().push_back(e.v);
+        n++;
+    }
+    Edge operator[](size_t i) const{
+        return Edge{cu[i / CHUNK][i % CHUNK], cv[i / CHUNK][i % CHUNK]};
+    }
+    size_t size() const{
+        return n;
+    }
+    bool empty() const{
+        return n == 0;
+    }
+    void clear(){
+        cu.clear();
+        cv.clear();
+        n = 0;
+    }
+    iterator begin() const{
+        return iterator{this, 0};
+    }
+    iterator end() const{
+        return iterator{this, n};
+    }
+};
+
 struct Partition{
     void add_edge(const Edge & e){
-        // NOTICE This function should be idempotent.
-        edges.insert(e);
+        // NOTICE This function is only idempotent with the dedupe index on.
+        // The stream dispenser already hands out every edge once.
+        if(indexed && !index.insert(e).second){
+            return;
+        }
+        edges.push_back(e);
     }
     Set<V> get_verts(){
         Set<V> verts;
@@ -127,12 +326,119 @@ struct Partition{
         }
         return verts;
     }
-    Set<Edge> edges;
-    bool contains(const Edge & e){
-        return edges.find(e) != edges.end();
+    EdgeColumns edges;
+    // Only partitions which are asked `contains()` need the index, it is built on first use.
+    // Building it mutates the partition, so concurrent readers need the owner's lock.
+    mutable bool indexed = false;
+    mutable std::unordered_set<Edge, EdgeHash> index;
+    void enable_index() const{
+        if(indexed){
+            return;
+        }
+        indexed = true;
+        index.clear();
+        index.reserve(edges.size());
+        for(const Edge & e: edges){
+            index.insert(e);
+        }
+    }
+    bool contains(const Edge & e) const{
+        enable_index();
+        return index.find(e) != index.end();
     }
 };
 
+struct PartitionLoads{
+    // Edge count of every partition, all a heuristic needs to know about them.
+    std::vector<LL> load;
+    // Tournament trees over `load`, node 1 is the root and leaves start at `leaf`.
+    // So the heaviest and lightest partition are known in O(1) and kept in O(log k).
+    std::vector<LL> tmax;
+    std::vector<LL> tmin;
+    size_t leaf = 1;
+
+    void resize(size_t k){
+        load.assign(k, 0);
+        build();
+    }
+    void build(){
+        // Call after writing `load` directly.
+        leaf = 1;
+        while(leaf < load.size()){
+            leaf <<= 1;
+        }
+        tmax.assign(2 * leaf, std::numeric_limits<LL>::min());
+        tmin.assign(2 * leaf, std::numeric_limits<LL>::max());
+        for(size_t i = 0; i < load.size(); i++){
+            tmax[leaf + i] = tmin[leaf + i] = load[i];
+        }
+        for(size_t i = leaf - 1; i >= 1; i--){
+            tmax[i] = std::max(tmax[2 * i], tmax[2 * i + 1]);
+            tmin[i] = std::min(tmin[2 * i], tmin[2 * i + 1]);
+        }
+    }
+    size_t size() const{
+        return load.size();
+    }
+    LL operator[](P p) const{
+        return load[p];
+    }
+    LL max() const{
+        return tmax[1];
+    }
+    LL min() const{
+        return tmin[1];
+    }
+    void add(P p, LL n = 1){
+        load[p] += n;
+        size_t i = leaf + p;
+        tmax[i] = tmin[i] = load[p];
+        for(i >>= 1; i >= 1; i >>= 1){
+            tmax[i] = std::max(tmax[2 * i], tmax[2 * i + 1]);
+            tmin[i] = std::min(tmin[2 * i], tmin[2 * i + 1]);
+        }
+    }
+};
+
+struct alignas(64) PaddedCounter{
+    // One cache line each, so writers of different partitions never false share.
+    std::atomic<LL> v;
+    PaddedCounter(){
+        v.store(0);
+    }
+};
+
+struct LoadCounters{
+    // Live per-partition edge counts, updated as partitions are written.
+    std::unique_ptr<PaddedCounter[]> c;
+    size_t k = 0;
+
+    void reset(size_t kk){
+        k = kk;
+        c.reset(new PaddedCounter[k]);
+    }
+    void clear(){
+        // Readers may hold on to the counters, so they are zeroed rather than reallocated.
+        for(size_t i = 0; i < k; i++){
+            c[i].v.store(0, std::memory_order_relaxed);
+        }
+    }
+    void add(P p, LL n){
+        c[p].v.fetch_add(n, std::memory_order_relaxed);
+    }
+    void store(P p, LL n){
+        c[p].v.store(n, std::memory_order_relaxed);
+    }
+    PartitionLoads snapshot() const{
+        PartitionLoads res;
+        res.resize(k);
+        for(size_t i = 0; i < k; i++){
+            res.load[i] = c[i].v.load(std::memory_order_relaxed);
+        }
+        res.build();
+        return res;
+    }
+};
 
 struct PartitionState{
     virtual std::set<Edge> get_edges() const = 0;
@@ -140,6 +446,8 @@ struct PartitionState{
     virtual Map<V, Vertex> get_verts() = 0;
     virtual Map<V, Vertex> get_verts(const Set<V> & vs) = 0;
     virtual std::vector<Partition> get_parts() = 0;
+    // Live edge counts only, without copying any partition.
+    virtual PartitionLoads get_loads() = 0;
     virtual void put_verts(const Map<V, Vertex> & delta) = 0;
     virtual void put_part(P i, const Partition & delta_part) = 0;
     virtual void put_parts(const std::vector<Partition> & delta) = 0;
@@ -147,9 +455,41 @@ struct PartitionState{
     virtual void crash(std::lock_guard<std::mutex> & guard) = 0;
     virtual bool is_crashed() = 0;
     virtual Edge get_edge(bool & valid) = 0;
+    // Appends at most n edges of the stream to batch, returns how many. 0 means no edges left.
+    // By default one get_edge() at a time, states override it where they can claim a whole range,
+    // or to take their lock once per batch, see get_edges_locked.
+    virtual size_t get_edges(size_t n, std::vector<Edge> & batch){
+        return take_edges(n, batch, [&](bool & valid){
+            return get_edge(valid);
+        });
+    }
+    // Durability barrier, returns once everything put so far has reached the backing store.
+    virtual void sync(){
+    }
     virtual ~PartitionState(){
 
     }    
+    template<typename F>
+    static size_t take_edges(size_t n, std::vector<Edge> & batch, F get_one){
+        size_t got = 0;
+        bool valid = false;
+        while(got < n){
+            Edge e = get_one(valid);
+            if(!valid){
+                break;
+            }
+            batch.push_back(e);
+            got++;
+        }
+        return got;
+    }
+    template<typename S>
+    static size_t get_edges_locked(S & state, std::lock_guard<std::mutex> & guard, size_t n, std::vector<Edge> & batch){
+        // For states whose get_edge(guard, valid) runs under their own lock, held here for the whole batch.
+        return take_edges(n, batch, [&](bool & valid){
+            return state.get_edge(guard, valid);
+        });
+    }
     void check_crashed(){
         using namespace std::chrono_literals;
         while(is_crashed()){
@@ -188,7 +528,7 @@ struct DebugStruct{
     }
 };
 
-typedef std::function<P(const Vertex & u, const Vertex & v, const std::vector<Partition> & parts)> HF;
+typedef std::function<P(const Vertex & u, const Vertex & v, const PartitionLoads & loads)> HF;
 
 struct PartitionConfig {
     int k; // How many partitions
@@ -200,4 +540,25 @@ struct PartitionConfig {
     bool lazy_load = false;
     HF hf;
     int crash_mode = 0;
+    int stripes = 16; // How many lock stripes the vertex state is sharded into
+    int out_ring = 1 << 16; // Capacity of each async subpartitioner's output ring
+    int flush_ms = 5; // Longest the async committer sleeps before committing
+    int loaders = 4; // Parallel connections loading the dataset into Redis
+    bool redis_resume = false; // Continue from the state an earlier run left in Redis instead of reloading
+    bool nuft_text = true; // Talk to kv in the text protocol, false needs a kv that speaks --binary
+    int nuft_inflight = 64; // Most kv commands awaiting acknowledgement
+    int replica_lag = 1 << 16; // Most edges the crash replica may fall behind by
+    std::string wal; // Crash recovery log, used instead of the kv replica when set
+    int recover_threads = 0; // Threads rebuilding vertex state on recover, 0 for all cores on large states
+};
+
+// Heuristic policies for Subpartitioner and friends.
+// A policy is a type with a static `select(config, u, v, loads)`, so the chosen
+// heuristic is inlined into the window loop. See heuristic.h for the static ones.
+// There is no default policy, partitioners name theirs, e.g. `MajorPartitioner<HdrfHeuristic>`.
+struct DynamicHeuristic{
+    // Opt-in runtime dispatch through PartitionConfig::hf, one indirect call per edge.
+    static P select(const PartitionConfig & config, const Vertex & u, const Vertex & v, const PartitionLoads & loads){
+        return config.hf(u, v, loads);
+    }
 };
@@ -0,0 +1,181 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#pragma once
+#include "partition_def.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NUCUT_X86_KERNELS
+#endif
+
+// Scoring kernel shared by the greedy and HDRF heuristics.
+// Partition i scores
+//     (i in u ? wu : 0) + (i in v ? wv : 0) + lambda * (max_size - load[i]) / (epsilon + max_size - min_size)
+// and the first partition with the highest score wins.
+// Every variant does the same double operations in the same order, so they all pick the same partition.
+
+struct ScoreParams{
+    double wu;
+    double wv;
+    double lambda;
+    double epsilon;
+    double max_size;
+    double min_size;
+};
+
+inline double score_partition(const ScoreParams & sp, double denom, LL load, bool inu, bool inv){
+    double rep = (inu ? sp.wu : 0.0) + (inv ? sp.wv : 0.0);
+    double bal = sp.lambda * (sp.max_size - (double)load) / denom;
+    return rep + bal;
+}
+
+inline std::vector<double> score_partitions(const ScoreParams & sp, const LL * load, const PartSet & u, const PartSet & v, size_t k){
+    double denom = sp.epsilon + sp.max_size - sp.min_size;
+    std::vector<double> ans;
+    ans.resize(k);
+    for(size_t i = 0; i < k; i++){
+        ans[i] = score_partition(sp, denom, load[i], u.contains(i), v.contains(i));
+    }
+    return ans;
+}
+
+inline P score_argmax_scalar(const ScoreParams & sp, const LL * load, const PartSet & u, const PartSet & v, size_t k, size_t from = 0, P best = -1, double best_s = 0){
+    double denom = sp.epsilon + sp.max_size - sp.min_size;
+    for(size_t i = from; i < k; i++){
+        uint64_t bu = u.bits(i / 64), bv = v.bits(i / 64);
+        double s = score_partition(sp, denom, load[i], (bu >> (i % 64)) & 1, (bv >> (i % 64)) & 1);
+        if(best == -1 || s > best_s){
+            best = i;
+            best_s = s;
+        }
+    }
+    return best;
+}
+
+#if defined(NUCUT_X86_KERNELS)
+inline void reduce_lanes(const double * s, const LL * idx, int lanes, P & best, double & best_s){
+    // Highest score first, then the lowest partition.
+    for(int j = 0; j < lanes; j++){
+        if(idx[j] < 0){
+            continue;
+        }
+        if(best == -1 || s[j] > best_s || (s[j] == best_s && idx[j] < best)){
+            best = idx[j];
+            best_s = s[j];
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+inline P score_argmax_avx2(const ScoreParams & sp, const LL * load, const PartSet & u, const PartSet & v, size_t k){
+    const __m256d wu = _mm256_set1_pd(sp.wu), wv = _mm256_set1_pd(sp.wv);
+    const __m256d lambda = _mm256_set1_pd(sp.lambda), max_size = _mm256_set1_pd(sp.max_size);
+    const __m256d denom = _mm256_set1_pd(sp.epsilon + sp.max_size - sp.min_size);
+    // Exact int64 -> double for 0 <= x < 2^52.
+    const __m256i magic_i = _mm256_set1_epi64x(0x4330000000000000ll);
+    const __m256d magic_d = _mm256_set1_pd(4503599627370496.0);
+    const __m256i lane_bit = _mm256_set_epi64x(8, 4, 2, 1);
+    const __m256i step = _mm256_set1_epi64x(4);
+    __m256d best = _mm256_set1_pd(-std::numeric_limits<double>::infinity());
+    __m256i best_i = _mm256_set1_epi64x(-1);
+    __m256i idx = _mm256_set_epi64x(3, 2, 1, 0);
+    size_t i = 0;
+    for(; i + 4 <= k; i += 4){
+        __m256i li = _mm256_loadu_si256((const __m256i *)(load + i));
+        __m256d ld = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(li, magic_i)), magic_d);
+        __m256i nu = _mm256_set1_epi64x((u.bits(i / 64) >> (i % 64)) & 0xF);
+        __m256i nv = _mm256_set1_epi64x((v.bits(i / 64) >> (i % 64)) & 0xF);
+        __m256d mu = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(nu, lane_bit), lane_bit));
+        __m256d mv = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(nv, lane_bit), lane_bit));
+        __m256d rep = _mm256_add_pd(_mm256_and_pd(mu, wu), _mm256_and_pd(mv, wv));
+        __m256d bal = _mm256_div_pd(_mm256_mul_pd(lambda, _mm256_sub_pd(max_size, ld)), denom);
+        __m256d s = _mm256_add_pd(rep, bal);
+        __m256d gt = _mm256_cmp_pd(s, best, _CMP_GT_OQ);
+        best = _mm256_blendv_pd(best, s, gt);
+        best_i = _mm256_castpd_si256(_mm256_blendv_pd(_mm256_castsi256_pd(best_i), _mm256_castsi256_pd(idx), gt));
+        idx = _mm256_add_epi64(idx, step);
+    }
+    alignas(32) double bs[4];
+    alignas(32) LL bi[4];
+    _mm256_store_pd(bs, best);
+    _mm256_store_si256((__m256i *)bi, best_i);
+    P res = -1;
+    double res_s = 0;
+    reduce_lanes(bs, bi, 4, res, res_s);
+    return score_argmax_scalar(sp, load, u, v, k, i, res, res_s);
+}
+
+__attribute__((target("avx512f,avx512dq")))
+inline P score_argmax_avx512(const ScoreParams & sp, const LL * load, const PartSet & u, const PartSet & v, size_t k){
+    const __m512d wu = _mm512_set1_pd(sp.wu), wv = _mm512_set1_pd(sp.wv);
+    const __m512d lambda = _mm512_set1_pd(sp.lambda), max_size = _mm512_set1_pd(sp.max_size);
+    const __m512d denom = _mm512_set1_pd(sp.epsilon + sp.max_size - sp.min_size);
+    const __m512i step = _mm512_set1_epi64(8);
+    __m512d best = _mm512_set1_pd(-std::numeric_limits<double>::infinity());
+    __m512i best_i = _mm512_set1_epi64(-1);
+    __m512i idx = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+    size_t i = 0;
+    for(; i + 8 <= k; i += 8){
+        __m512d ld = _mm512_cvtepi64_pd(_mm512_loadu_si512((const void *)(load + i)));
+        __mmask8 mu = (u.bits(i / 64) >> (i % 64)) & 0xFF;
+        __mmask8 mv = (v.bits(i / 64) >> (i % 64)) & 0xFF;
+        __m512d rep = _mm512_add_pd(_mm512_maskz_mov_pd(mu, wu), _mm512_maskz_mov_pd(mv, wv));
+        __m512d bal = _mm512_div_pd(_mm512_mul_pd(lambda, _mm512_sub_pd(max_size, ld)), denom);
+        __m512d s = _mm512_add_pd(rep, bal);
+        __mmask8 gt = _mm512_cmp_pd_mask(s, best, _CMP_GT_OQ);
+        best = _mm512_mask_mov_pd(best, gt, s);
+        best_i = _mm512_mask_mov_epi64(best_i, gt, idx);
+        idx = _mm512_add_epi64(idx, step);
+    }
+    alignas(64) double bs[8];
+    alignas(64) LL bi[8];
+    _mm512_store_pd(bs, best);
+    _mm512_store_si512((void *)bi, best_i);
+    P res = -1;
+    double res_s = 0;
+    reduce_lanes(bs, bi, 8, res, res_s);
+    return score_argmax_scalar(sp, load, u, v, k, i, res, res_s);
+}
+#endif
+
+typedef P (*ScoreKernel)(const ScoreParams & sp, const LL * load, const PartSet & u, const PartSet & v, size_t k);
+
+inline P score_argmax_fallback(const ScoreParams & sp, const LL * load, const PartSet & u, const PartSet & v, size_t k){
+    return score_argmax_scalar(sp, load, u, v, k);
+}
+
+inline ScoreKernel select_score_kernel(){
+    #if defined(NUCUT_X86_KERNELS)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")){
+        return score_argmax_avx512;
+    }
+    if(__builtin_cpu_supports("avx2")){
+        return score_argmax_avx2;
+    }
+    #endif
+    return score_argmax_fallback;
+}
+
+inline P score_argmax(const ScoreParams & sp, const LL * load, const PartSet & u, const PartSet & v, size_t k){
+    // Picked once, by what the running CPU supports.
+    static const ScoreKernel kernel = select_score_kernel();
+    return kernel(sp, load, u, v, k);
+}
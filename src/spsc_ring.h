@@ -0,0 +1,128 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#pragma once
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <cstddef>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <cassert>
+
+// Bounded lock-free ring with one producer and one consumer.
+// Both indexes only grow; slot = index & mask. Each side caches the other's
+// index and re-reads it only when the ring looks full (or empty), so most
+// operations never touch the other side's cache line.
+template<typename T>
+struct SpscRing{
+    // Raw slots, T need not be default constructible (Edge is not).
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Slot;
+    std::unique_ptr<Slot[]> buf;
+    size_t mask = 0;
+
+    // Producer side
+    alignas(64) std::atomic<size_t> head{0};
+    size_t tail_cache = 0;
+    // Consumer side
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t head_cache = 0;
+
+    SpscRing(){
+    }
+    SpscRing(const SpscRing &) = delete;
+    SpscRing & operator=(const SpscRing &) = delete;
+    ~SpscRing(){
+        clear();
+    }
+
+    T * slot(size_t i){
+        return reinterpret_cast<T *>(&buf[i & mask]);
+    }
+
+    void init(size_t capacity){
+        // Rounded up to a power of two. Not thread safe, call before both sides start.
+        clear();
+        size_t c = 1;
+        while(c < capacity){
+            c <<= 1;
+        }
+        buf.reset(new Slot[c]);
+        mask = c - 1;
+        head.store(0);
+        tail.store(0);
+        tail_cache = head_cache = 0;
+    }
+    size_t capacity() const{
+        return mask + 1;
+    }
+
+    bool try_push(const T & x){
+        size_t h = head.load(std::memory_order_relaxed);
+        if(h - tail_cache > mask){
+            tail_cache = tail.load(std::memory_order_acquire);
+            if(h - tail_cache > mask){
+                return false;
+            }
+        }
+        new (slot(h)) T(x);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+    void push(const T & x){
+        // Backpressure, the producer waits for the consumer instead of growing.
+        while(!try_push(x)){
+            std::this_thread::yield();
+        }
+    }
+
+    template<typename F>
+    size_t drain(size_t max_n, F f){
+        // Hands up to max_n items to f, releases their slots in one store.
+        size_t t = tail.load(std::memory_order_relaxed);
+        if(head_cache == t){
+            head_cache = head.load(std::memory_order_acquire);
+        }
+        size_t n = std::min(head_cache - t, max_n);
+        for(size_t i = 0; i < n; i++){
+            T * p = slot(t + i);
+            f(*p);
+            p->~T();
+        }
+        if(n){
+            tail.store(t + n, std::memory_order_release);
+        }
+        return n;
+    }
+
+    void clear(){
+        if(buf){
+            drain(capacity(), [](const T &){});
+        }
+    }
+
+    size_t size() const{
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+    bool empty() const{
+        return size() == 0;
+    }
+};
@@ -24,36 +24,89 @@
 
 PartitionStateLocal::PartitionStateLocal(PartitionConfig c) : config(c){
     config.state = this;
-    f = std::fopen(config.dataset.c_str(), "r");
+    nstripes = std::max(1, config.stripes);
+    stripes.reset(new VertexStripe[nstripes]);
+    if(EdgeStore::is_binary(config.dataset)){
+        // A binary edge list is already deduplicated, so there is nothing to load lazily.
+        if(!edges.open_binary(config.dataset)){
+            LOG_FATAL("Can't map binary edge list %s, it is truncated or of another version\n", config.dataset.c_str());
+        }
+        config.lazy_load = false;
+    }else if(config.lazy_load){
+        f = std::fopen(config.dataset.c_str(), "r");
+        if(!f){
+            LOG_FATAL("Can't open %s\n", config.dataset.c_str());
+        }
+    }
     if(config.lazy_load){
         init_bloom();
     }else{
         strict_load();
     }
-    printf("Edges %u Vertexs %u\n", edges.size(), verts.size());
-    cursor = edges.begin();
+    LOG_INFO("Edges %zu Vertexs %zu\n", edges.size(), verts_size());
+    cursor.store(0);
     parts.resize(config.k);
-    if(config.crash_mode != 0){
+    loads.reset(config.k);
+    if(needs_index()){
+        for(Partition & p: parts){
+            p.enable_index();
+        }
+    }
+    if(config.crash_mode != 0 && !config.wal.empty()){
+        std::vector<Partition> old_parts;
+        wal = new EdgeLog(config.wal, config.k, config.replica_lag, old_parts);
+        size_t old_edges = 0;
+        for(const Partition & p: old_parts){
+            old_edges += p.edges.size();
+        }
+        if(old_edges){
+            LOG_INFO("Resuming from WAL %s with %zu edges\n", config.wal.c_str(), old_edges);
+            std::lock_guard<std::mutex> guard((mut));
+            resumed = true;
+            recover(guard, old_parts);
+        }
+    }else if(config.crash_mode != 0){
         pstate_nuft = new PartitionStateNuft(config);
+        replicator = new Replicator(pstate_nuft, config.k, config.replica_lag);
     }
 }
 
 PartitionStateLocal::~PartitionStateLocal(){
+    print_stripes();
     delete bfilter;
-    std::fclose(f);
-    if(config.crash_mode != 0){
-        delete pstate_nuft;
+    if(f){
+        std::fclose(f);
     }
+    delete wal;
+    delete replicator;
+    delete pstate_nuft;
 }
 
 
 void PartitionStateLocal::put_part(std::lock_guard<std::mutex> & guard, P i, const Partition & delta_part){
     // check_crashed();
+    if(delta_part.edges.empty()){
+        return;
+    }
+    size_t before = parts[i].edges.size();
+    // Only what is new here is replicated, and only once.
+    Partition fresh;
     for(auto && edge: delta_part.edges){
+        if(config.crash_mode == 2 && is_committed(edge)){
+            // A window dispensed before the simulated crash is committed after recover(),
+            // while recover() has already handed its edges out again.
+            continue;
+        }
         parts[i].add_edge(edge);
+        if((replicator || wal) && parts[i].edges.size() != before + fresh.edges.size()){
+            fresh.add_edge(edge);
+        }
     }
-    if(config.crash_mode != 0){
-        pstate_nuft->put_part(i, delta_part);
+    loads.add(i, parts[i].edges.size() - before);
+    if(wal){
+        wal->append(i, fresh);
+    }else if(replicator){
+        replicator->push(i, std::move(fresh));
     }
 }
 
@@ -68,41 +121,58 @@ void PartitionStateLocal::put_parts(const std::vector<Partition> & delta){
     for(P i = 0; i < delta.size(); i++){
         put_part(guard, i, delta[i]);
     }    
-    if(config.crash_mode != 0){
-        pstate_nuft->put_parts(delta);
-    }
 }
 
 int all_saved_edges(PartitionConfig config){
     int tot = 0;
-    auto parts = config.state->get_parts();
-    for(auto && p: parts){
-        tot += p.edges.size();
+    auto loads = config.state->get_loads();
+    for(LL l: loads.load){
+        tot += l;
     }
     return tot;
 }
 
-Edge PartitionStateLocal::get_edge(bool & valid){
-    std::lock_guard<std::mutex> guard((mut));
+size_t PartitionStateLocal::get_edges(size_t n, std::vector<Edge> & batch){
+    if(config.lazy_load || config.crash_mode == 2 || resumed){
+        // Lazy load parses the file, crash mode 2 crashes at a given edge,
+        // and a resumed run skips committed edges, so they dispense one edge at a time.
+        std::lock_guard<std::mutex> guard((mut));
+        return get_edges_locked(*this, guard, n, batch);
+    }
+    // Claim [b, b + n) of the stream at once.
+    size_t total = edges.size();
+    size_t b = cursor.fetch_add(n);
+    if(b >= total){
+        return 0;
+    }
+    size_t e = std::min(b + n, total);
+    batch.insert(batch.end(), edges.begin() + b, edges.begin() + e);
+    ei.fetch_add(e - b);
+    return e - b;
+}
+
+Edge PartitionStateLocal::get_edge(std::lock_guard<std::mutex> & guard, bool & valid){
     if(config.lazy_load){
         LL u, v;
         REP:
         if(~fscanf(f, "%lld %lld\n", &u, &v)){
-            if(is_repeated(Edge{u, v})){
+            if(is_repeated(Edge{u, v}) || (resumed && is_committed(Edge{u, v}))){
                 goto REP;
             }else{
                 valid = 1;
                 ei ++;
-                edges.insert(Edge{u, v});
+                edges.push_back(Edge{u, v});
+                intern(u);
+                intern(v);
                 return Edge{u, v};
             }
         }
-        printf("ei: %d\n", ei);
+        LOG_DEBUG("ei: %d\n", ei.load());
         valid = 0;
         return Edge{0, 0};
     }else{
         if(config.crash_mode == 2){
-            if(ei == 2000){
+            if(ei.load() == 2000){
                 int X = all_saved_edges(config);
                 printf("Test crash all edge is %d\n", X);
                 fprintf(config.ds->f, "Test crash all edge is %d\n", X);
@@ -110,11 +180,20 @@ Edge PartitionStateLocal::get_edge(bool & valid){
                     fprintf(config.ds->f, "TP %d\n", p.edges.size());
                     printf("TP %d\n", p.edges.size());
                 }
+                // The replica has to hold exactly what was committed before the crash.
+                sync();
                 crash(guard);
                 printf("Finish crash\n");
                 fprintf(config.ds->f, "Finish crash\n");
                 uint64_t start_time = get_current_ms();
-                std::vector<Partition> p = pstate_nuft->get_parts();
+                std::vector<Partition> p;
+                if(wal){
+                    if(!EdgeLog::replay(config.wal, p)){
+                        LOG_FATAL("Can't replay WAL %s\n", config.wal.c_str());
+                    }
+                }else{
+                    p = pstate_nuft->get_parts();
+                }
                 printf("get parts from p %d\n", p.size());
                 fprintf(config.ds->f, "get parts from p %d\n", p.size());
                 recover(guard, p);
@@ -130,12 +209,16 @@ Edge PartitionStateLocal::get_edge(bool & valid){
                 fprintf(config.ds->f, "Recover Elapsed %llu\n", end_time - start_time);
             }
         }
-        if(cursor != edges.end()){
+        size_t i = cursor.fetch_add(1);
+        while(resumed && i < edges.size() && is_committed(edges[i])){
+            i = cursor.fetch_add(1);
+        }
+        if(i < edges.size()){
             valid = 1;
             ei ++;
-            return *(cursor++);
+            return edges[i];
         }else{
-            printf("At the end, ei: %d\n", ei);
+            LOG_INFO("At the end, ei: %d\n", ei.load());
             valid = 0;
             return Edge{0, 0};
         }
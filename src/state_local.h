@@ -21,22 +21,150 @@
 #pragma once
 #include "partition.h"
 #include "bloom_filter.hpp"
+#include "edge_store.h"
+#include "wal.h"
 #include <sstream>
 #include <chrono>
+#include <deque>
+
+struct VertexStripe{
+    // One shard of the vertex state, with its own lock.
+    // Vertex state lives in a flat table indexed by the dense id from `dict`.
+    std::mutex mut;
+    VertexDict dict;
+    std::vector<Vertex> table;
+    // How often the lock was taken, and how often it was already held by others.
+    std::atomic<uint64_t> acquired{0};
+    std::atomic<uint64_t> contended{0};
+
+    std::unique_lock<std::mutex> lock(){
+        std::unique_lock<std::mutex> l(mut, std::try_to_lock);
+        if(!l.owns_lock()){
+            contended.fetch_add(1, std::memory_order_relaxed);
+            l.lock();
+        }
+        acquired.fetch_add(1, std::memory_order_relaxed);
+        return l;
+    }
+    VI intern(V v){
+        VI i = dict.intern(v);
+        if(i == table.size()){
+            table.push_back(Vertex());
+        }
+        return i;
+    }
+    Vertex & at(V v){
+        return table[intern(v)];
+    }
+};
+
+struct Replicator{
+    // Ships committed deltas to a replica from a background thread, in commit order,
+    // so committing never waits on the replica itself. Deltas queued together are
+    // merged per partition. Once max_lag edges are waiting, push() blocks.
+    PartitionState * replica;
+    size_t max_lag;
+    size_t k;
+    std::mutex mut;
+    std::condition_variable cv;
+    std::deque<std::pair<P, Partition>> queue;
+    // Edges pushed but not yet handed to the replica, including the batch being shipped.
+    size_t lag = 0;
+    bool stop = false;
+    std::thread * th;
+
+    Replicator(PartitionState * r, size_t k_, size_t lag_) : replica(r), max_lag(std::max<size_t>(1, lag_)), k(k_){
+        th = new std::thread(&Replicator::main_proc, this);
+    }
+    ~Replicator(){
+        {
+            std::lock_guard<std::mutex> guard((mut));
+            stop = true;
+        }
+        cv.notify_all();
+        th->join();
+        delete th;
+    }
+    void push(P i, Partition && delta){
+        size_t n = delta.edges.size();
+        if(!n){
+            return;
+        }
+        std::unique_lock<std::mutex> lk((mut));
+        // A single delta larger than max_lag is let through once the queue is empty.
+        cv.wait(lk, [&](){ return lag == 0 || lag + n <= max_lag; });
+        queue.emplace_back(i, std::move(delta));
+        lag += n;
+        cv.notify_all();
+    }
+    void sync(){
+        // Waits until the replica has been handed every delta pushed so far,
+        // then for the replica's own barrier.
+        {
+            std::unique_lock<std::mutex> lk((mut));
+            cv.wait(lk, [&](){ return lag == 0; });
+        }
+        replica->sync();
+    }
+    void main_proc(){
+        std::vector<Partition> batch(k);
+        while(1){
+            std::deque<std::pair<P, Partition>> q;
+            {
+                std::unique_lock<std::mutex> lk((mut));
+                cv.wait(lk, [&](){ return stop || !queue.empty(); });
+                if(queue.empty()){
+                    return;
+                }
+                q.swap(queue);
+            }
+            size_t n = 0;
+            for(auto && pr: q){
+                for(auto && e: pr.second.edges){
+                    batch[pr.first].add_edge(e);
+                }
+                n += pr.second.edges.size();
+            }
+            for(P i = 0; i < k; i++){
+                if(!batch[i].edges.empty()){
+                    replica->put_part(i, batch[i]);
+                    batch[i].edges.clear();
+                }
+            }
+            {
+                std::lock_guard<std::mutex> guard((mut));
+                lag -= n;
+            }
+            cv.notify_all();
+        }
+    }
+};
 
 struct PartitionStateLocal : public PartitionState{
 protected:
     PartitionConfig config;
-    Map<V, Vertex> verts;
+    // Vertex state is sharded by vertex id, so merges from different
+    // subpartitioners only serialize when they touch the same stripe.
+    std::unique_ptr<VertexStripe[]> stripes;
+    size_t nstripes = 1;
     std::vector<Partition> parts;
-    std::set<Edge> edges;
+    LoadCounters loads;
+    EdgeStore edges;
     mutable std::mutex mut;
-    std::set<Edge>::iterator cursor;
-    int ei = 0;
+    // Position of the next edge to dispense in `edges`.
+    // Strict load claims whole ranges of it without `mut`.
+    std::atomic<size_t> cursor{0};
+    std::atomic<int> ei{0};
+    // Distinct edges among the first distinct_at lazily dispensed ones, see edges_size().
+    mutable size_t distinct_n = 0, distinct_at = 0;
     bloom_filter * bfilter = nullptr;
-    FILE * f;
-    struct PartitionStateNuft * pstate_nuft;
+    FILE * f = nullptr;
+    struct PartitionStateNuft * pstate_nuft = nullptr;
+    Replicator * replicator = nullptr;
+    EdgeLog * wal = nullptr;
     bool crashed = false;
+    // Restarted from a WAL, edges it already holds are not dispensed again.
+    bool resumed = false;
 public:
     void init_bloom(){
         bloom_parameters parameters;
@@ -50,25 +178,93 @@ public:
     bool is_crashed();
     int edges_size() const{
         // check_crashed();
+        if(config.lazy_load){
+            // Lazily dispensed edges may repeat, see is_repeated().
+            // They are counted once, and again only after more were dispensed.
+            std::lock_guard<std::mutex> guard((mut));
+            if(distinct_at != edges.size()){
+                distinct_n = edges.to_set().size();
+                distinct_at = edges.size();
+            }
+            return distinct_n;
+        }
+        // A binary edge list has the count in its header.
         return edges.size();
     }
     std::set<Edge> get_edges() const{
         // check_crashed();
-        return edges;
+        return edges.to_set();
+    }
+    size_t stripe_of(V v) const{
+        return ((uint64_t)v * 0x9E3779B97F4A7C15ull >> 32) % nstripes;
+    }
+    Vertex & vertex(V v){
+        // Caller must hold the lock of v's stripe, or be the only thread around.
+        return stripes[stripe_of(v)].at(v);
+    }
+    void intern(V v){
+        VertexStripe & s = stripes[stripe_of(v)];
+        auto l = s.lock();
+        s.intern(v);
+    }
+    std::vector<std::unique_lock<std::mutex>> lock_stripes(){
+        // Always in the same order.
+        std::vector<std::unique_lock<std::mutex>> ls;
+        for(size_t i = 0; i < nstripes; i++){
+            ls.push_back(stripes[i].lock());
+        }
+        return ls;
+    }
+    template<typename T, typename K, typename F>
+    void for_stripes(const T & items, K key, F f){
+        // Visits items grouped by stripe, holding each stripe's lock once.
+        std::vector<std::vector<const typename T::value_type *>> by(nstripes);
+        for(auto && item: items){
+            by[stripe_of(key(item))].push_back(&item);
+        }
+        for(size_t i = 0; i < nstripes; i++){
+            if(by[i].empty()){
+                continue;
+            }
+            auto l = stripes[i].lock();
+            for(auto item: by[i]){
+                f(stripes[i], *item);
+            }
+        }
+    }
+    size_t verts_size() const{
+        size_t n = 0;
+        for(size_t i = 0; i < nstripes; i++){
+            n += stripes[i].dict.size();
+        }
+        return n;
+    }
+    void print_stripes() const{
+        // Lock contention per stripe, for tuning config.stripes.
+        for(size_t i = 0; i < nstripes; i++){
+            LOG_DEBUG("Stripe[%zu] vertex %zu acquired %llu contended %llu\n", i, stripes[i].dict.size(),
+                (unsigned long long)stripes[i].acquired.load(), (unsigned long long)stripes[i].contended.load());
+        }
     }
     Map<V, Vertex> get_verts(){
         // check_crashed();
-        return verts;
+        Map<V, Vertex> res;
+        for(size_t i = 0; i < nstripes; i++){
+            VertexStripe & s = stripes[i];
+            auto l = s.lock();
+            for(VI j = 0; j < s.table.size(); j++){
+                res[s.dict.to_raw(j)] = s.table[j];
+            }
+        }
+        return res;
     }
     Map<V, Vertex> get_verts(const Set<V> & vs){
         // check_crashed();
+        // Lazy load may still intern new vertices, so stripes are locked.
         Map<V, Vertex> res;
-        for(auto v : vs){
-            if(verts.find(v) == verts.end()){
-                verts[v] = Vertex();
-            }
-            res[v] = verts[v];
-        }
+        for_stripes(vs, [](V v){ return v; }, [&](VertexStripe & s, V v){
+            res[v] = s.at(v);
+        });
         return res;
     }
     std::vector<Partition> get_parts(){
@@ -76,80 +272,158 @@ public:
         // check_crashed();
         return parts;
     }
+    PartitionLoads get_loads(){
+        return loads.snapshot();
+    }
     void put_verts(const Map<V, Vertex> & delta){
         // check_crashed();
-        std::lock_guard<std::mutex> guard((mut));
-        for(auto && pr: delta){
-            verts[pr.first].deg.fetch_add(pr.second.delta_deg);
-            for(auto p : pr.second.parts){
-                verts[pr.first].parts.insert(p);
-            }
-        }
+        typedef std::pair<const V, Vertex> Item;
+        for_stripes(delta, [](const Item & pr){ return pr.first; }, [](VertexStripe & s, const Item & pr){
+            Vertex & vert = s.at(pr.first);
+            vert.deg.fetch_add(pr.second.delta_deg);
+            vert.parts.merge(pr.second.parts);
+        });
     }
     void put_part(std::lock_guard<std::mutex> & guard, P i, const Partition & delta_part);
     void put_parts(const std::vector<Partition> & delta);
+    void sync(){
+        if(replicator){
+            replicator->sync();
+        }
+        if(wal && !wal->sync()){
+            LOG_FATAL("WAL %s is not durable, see the write error above\n", config.wal.c_str());
+        }
+    }
     void put_part(P i, const Partition & delta_part){
         std::lock_guard<std::mutex> guard((mut));
         put_part(guard, i, delta_part); 
     }
 
     void strict_load(){
-        LL u, v;
-        while(~fscanf(f, "%lld %lld\n", &u, &v)){
-            if(u != v){
-                Edge e = Edge{u, v};
-                edges.insert(e);
-                verts[u] = Vertex();
-                verts[v] = Vertex();
-            }
+        // A mapped binary edge list needs no parsing.
+        if(!edges.is_mapped() && !edges.load_text(config.dataset)){
+            LOG_FATAL("Can't read %s\n", config.dataset.c_str());
+        }
+        for(const Edge & e: edges){
+            vertex(e.u);
+            vertex(e.v);
         }
     }
     void recover(std::lock_guard<std::mutex> & guard, const std::vector<Partition> & old_parts){
+        // Vertex state is rebuilt on all cores. Each thread takes an even share of the edges,
+        // regardless of partition boundaries, and sorts their endpoints into partial lists by stripe.
+        // Then each stripe is merged by a single thread.
         parts = old_parts;
-        cursor = edges.begin();
-        for(int i = 0; i < parts.size(); i++){
-            const Partition & p = parts[i];
-            for(int jj = 0; jj < p.edges.size(); jj++){
-                cursor ++;
+        auto ls = lock_stripes();
+        if(needs_index()){
+            for(Partition & p: parts){
+                p.enable_index();
             }
-            for(const Edge & e: p.edges){
-                if(verts.find(e.v) == verts.end()){
-                    verts[e.v] = Vertex();
+        }
+        std::vector<size_t> off(parts.size() + 1, 0);
+        for(int i = 0; i < parts.size(); i++){
+            loads.store(i, parts[i].edges.size());
+            off[i + 1] = off[i] + parts[i].edges.size();
+        }
+        size_t total = off.back();
+        int threads = config.recover_threads;
+        if(threads < 1){
+            threads = total < (1 << 16) ? 1 : std::thread::hardware_concurrency();
+        }
+        threads = std::max(1, threads);
+
+        typedef std::vector<std::pair<V, P>> Partial;
+        std::vector<std::vector<Partial>> partial(threads, std::vector<Partial>(nstripes));
+        std::vector<std::thread> ths;
+        for(int t = 0; t < threads; t++){
+            ths.emplace_back([&, t](){
+                std::vector<Partial> & mine = partial[t];
+                size_t lo = total * t / threads, hi = total * (t + 1) / threads;
+                size_t i = std::upper_bound(off.begin(), off.end(), lo) - off.begin() - 1;
+                for(size_t g = lo; g < hi; i++){
+                    const EdgeColumns & es = parts[i].edges;
+                    size_t end = std::min(hi, off[i + 1]);
+                    for(size_t j = g - off[i]; j < end - off[i]; j++){
+                        Edge e = es[j];
+                        mine[stripe_of(e.u)].emplace_back(e.u, i);
+                        mine[stripe_of(e.v)].emplace_back(e.v, i);
+                    }
+                    g = end;
                 }
-                verts[e.v].deg.fetch_add(1);
-                verts[e.v].parts.insert(i);
-                if(verts.find(e.u) == verts.end()){
-                    verts[e.u] = Vertex();
+            });
+        }
+        for(auto && t: ths){
+            t.join();
+        }
+        ths.clear();
+        // All stripe locks are held above, on behalf of the merging threads.
+        int mergers = std::min<size_t>(threads, nstripes);
+        for(int m = 0; m < mergers; m++){
+            ths.emplace_back([&, m](){
+                for(size_t s = m; s < nstripes; s += mergers){
+                    for(int t = 0; t < threads; t++){
+                        for(auto && pr: partial[t][s]){
+                            Vertex & vert = stripes[s].at(pr.first);
+                            vert.deg.fetch_add(1, std::memory_order_relaxed);
+                            vert.parts.insert(pr.second);
+                        }
+                        Partial().swap(partial[t][s]);
+                    }
                 }
-                verts[e.u].deg.fetch_add(1);
-                verts[e.u].parts.insert(i);
-            }
+            });
+        }
+        for(auto && t: ths){
+            t.join();
         }
+        // Everything committed precedes the cursor, so it resumes right after.
+        // Not so after a restart, the stream is then scanned again and committed edges are skipped.
+        cursor.store(resumed ? 0 : total);
         crashed = false;
     }
     void crash(std::lock_guard<std::mutex> & guard){
         crashed = true;
         parts.clear();
-        verts.clear();
+        loads.clear();
+        // The id dictionary is derived from the dataset, only the vertex state is lost.
+        auto ls = lock_stripes();
+        for(size_t i = 0; i < nstripes; i++){
+            for(Vertex & vert: stripes[i].table){
+                vert = Vertex();
+            }
+        }
+    }
+    bool needs_index() const{
+        // is_repeated() checks bloom filter hits against the partitions,
+        // crash mode 2 has to drop windows which were in flight when crashed,
+        // and a resumed run skips what the WAL already holds.
+        return config.lazy_load || config.crash_mode == 2 || resumed;
+    }
+    bool is_committed(const Edge & e) const{
+        for(const Partition & p: parts){
+            if(p.contains(e)){
+                return true;
+            }
+        }
+        return false;
     }
     bool is_repeated(const Edge & e){
         bool con = bfilter->contains(e.to_string());
         bfilter->insert(e.to_string());
         if(con){
             // Test FP
-            for(const Partition & p: parts){
-                if(p.contains(e)){
-                    return true;
-                }
-            }
-            return false;
+            return is_committed(e);
         }else{
             return false;
         }
     }
     PartitionStateLocal(PartitionConfig c);
     ~PartitionStateLocal();
-    Edge get_edge(bool & valid);
+    Edge get_edge(std::lock_guard<std::mutex> & guard, bool & valid);
+    Edge get_edge(bool & valid){
+        std::lock_guard<std::mutex> guard((mut));
+        return get_edge(guard, valid);
+    }
+    size_t get_edges(size_t n, std::vector<Edge> & batch);
 };
 
 
@@ -172,6 +446,9 @@ public:
     }
     std::vector<Partition> get_parts(){
 
+    }
+    PartitionLoads get_loads(){
+        return PartitionLoads{};
     }
     void put_verts(const Map<V, Vertex> & delta){
 
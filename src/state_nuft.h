@@ -20,10 +20,11 @@
 
 #pragma once
 #include "partition.h"
+#include "edge_store.h"
 #include <sstream>
+#include <deque>
 
 #include "subprocess.h"
-static char buff[100000];
 
 namespace Nuke{
 inline std::vector<std::string> split(const std::string & s, const std::string & splitter){
@@ -42,33 +43,154 @@ inline std::vector<std::string> split(const std::string & s, const std::string &
 }
 };
 
-inline std::string read_until(int fd, char term = '\n'){
-    char b[10];
-    std::string s;
-    while(1){
-        read(fd, b, 1);
-        s += b[0];
-        if(b[0] == '\n'){
-            break;
+struct PipeReader{
+    // Buffered reader of the kv's stdout. Reads come in large chunks, and lines
+    // are cut with memchr instead of one read() per byte.
+    static const size_t CHUNK = 1 << 16;
+    int fd = -1;
+    std::vector<char> buf;
+    size_t pos = 0, end = 0;
+
+    PipeReader(){
+    }
+    PipeReader(int f) : fd(f), buf(CHUNK){
+    }
+    size_t buffered() const{
+        return end - pos;
+    }
+    bool fill(){
+        // Appends whatever the pipe has, making room first. The consumed prefix is
+        // always dropped, so the buffer only grows for a line longer than it.
+        if(pos > 0){
+            std::memmove(buf.data(), buf.data() + pos, end - pos);
+            end -= pos;
+            pos = 0;
+        }
+        if(buf.size() - end < CHUNK / 2){
+            buf.resize(buf.size() * 2);
         }
+        ssize_t r;
+        do{
+            r = read(fd, buf.data() + end, buf.size() - end);
+        }while(r < 0 && errno == EINTR);
+        if(r <= 0){
+            return false;
+        }
+        end += r;
+        return true;
     }
-    return s;
-}
+    bool read_line(std::string & line, char term = '\n'){
+        // The line keeps its terminator.
+        size_t scanned = pos;
+        while(1){
+            const char * p = (const char *)std::memchr(buf.data() + scanned, term, end - scanned);
+            if(p){
+                size_t n = p - (buf.data() + pos) + 1;
+                line.assign(buf.data() + pos, n);
+                pos += n;
+                return true;
+            }
+            scanned = end - pos;
+            if(!fill()){
+                return false;
+            }
+            scanned += pos;
+        }
+    }
+    bool read_exact(void * out, size_t n){
+        char * o = (char *)out;
+        size_t take = std::min(n, buffered());
+        std::memcpy(o, buf.data() + pos, take);
+        pos += take;
+        o += take;
+        n -= take;
+        // Large payloads skip the buffer.
+        while(n >= CHUNK){
+            ssize_t r = read(fd, o, n);
+            if(r < 0 && errno == EINTR){
+                continue;
+            }
+            if(r <= 0){
+                return false;
+            }
+            o += r;
+            n -= r;
+        }
+        while(n){
+            if(!fill()){
+                return false;
+            }
+            take = std::min(n, buffered());
+            std::memcpy(o, buf.data() + pos, take);
+            pos += take;
+            o += take;
+            n -= take;
+        }
+        return true;
+    }
+};
+
+// Binary framing of the kv pipe, opted into with PartitionConfig::nuft_text = false.
+// kv must then understand --binary, the line-based text protocol is the default.
+// Every request and every response is a NuftFrame followed by `len` bytes of payload.
+//   SADD key=i, payload = edges     ->  OK, no payload
+//   SGET key=i, no payload          ->  OK, payload = edges of P<i>
+// Edges are packed arrays of Edge, int64 (u, v) in host byte order, since both ends
+// of the pipe run on the same host. Responses come back in request order with
+// the request's seq. The text protocol is "SADD P<i> 'u,v;u,v'" and "SGET P<i>".
+enum NuftOp : uint32_t{
+    NUFT_SADD = 1,
+    NUFT_SGET = 2,
+    NUFT_OK = 0x80,
+    NUFT_ERR = 0x81,
+};
+
+struct NuftFrame{
+    uint32_t op;
+    uint32_t seq;
+    int64_t key;
+    uint64_t len;
+};
+static_assert(sizeof(NuftFrame) == 24, "Unexpected NuftFrame layout");
 
 struct PartitionStateNuft : public PartitionState{
 protected:
     PartitionConfig config;
     Map<V, Vertex> verts;
-    std::set<Edge> edges;
+    EdgeStore edges;
+    LoadCounters loads;
     std::mutex mut;
-    std::set<Edge>::iterator cursor;
+    size_t cursor = 0;
     int ei = 0;
     subprocess::Popen * proc;
+    PipeReader reader;
+    uint32_t seq = 0;
+    // Packed edges, u and v interleaved, as they travel over the pipe.
+    std::vector<LL> packed;
+
+    // Commands are pipelined, up to inflight_cap of them await their reply.
+    // kv answers in order, so ack_proc matches each reply with the front of inflight.
+    // A command's ticket is its position in the stream, it is done once acked reaches it.
+    struct Pending{
+        uint32_t op;
+        P i;
+        size_t n;
+        std::vector<LL> * out;
+    };
+    std::mutex write_mut;
+    std::mutex ack_mut;
+    std::condition_variable ack_cv;
+    std::deque<Pending> inflight;
+    // config.nuft_inflight, at least 1 or submit would wait forever.
+    size_t inflight_cap = 1;
+    uint64_t sent = 0, acked = 0;
+    bool broken = false;
+    std::thread * acker = nullptr;
     // FILE * pwrite;
     // FILE * fread;
 public:
     std::set<Edge> get_edges() const{
-        return edges;
+        return edges.to_set();
     }
     int edges_size() const{
         return edges.size();
@@ -89,62 +211,182 @@ public:
     bool is_crashed(){
         return false;
     }
+    uint64_t submit(const Pending & pd){
+        // Called under write_mut right before the command is written, waits for room in the pipeline.
+        // Returns 0 once kv is gone, the command must then not be written.
+        std::unique_lock<std::mutex> lk((ack_mut));
+        ack_cv.wait(lk, [&](){ return inflight.size() < inflight_cap || broken; });
+        if(broken){
+            return 0;
+        }
+        inflight.push_back(pd);
+        return ++sent;
+    }
+    bool send_frame(uint32_t op, P i, const void * payload, size_t len){
+        NuftFrame h{op, seq++, i, len};
+        FILE * in = proc->input();
+        bool ok = std::fwrite(&h, sizeof h, 1, in) == 1;
+        ok = ok && (!len || std::fwrite(payload, 1, len, in) == len);
+        return std::fflush(in) == 0 && ok;
+    }
+    bool recv_frame(NuftFrame & h, std::vector<LL> & payload){
+        if(!reader.read_exact(&h, sizeof h)){
+            return false;
+        }
+        assert(h.len % sizeof(Edge) == 0);
+        payload.resize(h.len / sizeof(LL));
+        return reader.read_exact(payload.data(), h.len);
+    }
+    static void parse_text_edges(const std::string & ans, std::vector<LL> & out){
+        std::vector<std::string> ess = Nuke::split(ans, ";");
+        // printf("Split Res %d\n", ess.size());
+        for(auto && es: ess){
+            LL u, v;
+            if(~sscanf(es.c_str(), "%lld,%lld", &u, &v)){
+                out.push_back(u);
+                out.push_back(v);
+            }
+        }
+    }
+    void ack_proc(){
+        std::vector<LL> payload;
+        std::string ans;
+        while(1){
+            bool ok;
+            if(!config.nuft_text){
+                NuftFrame h;
+                ok = recv_frame(h, payload) && h.op == NUFT_OK;
+            }else{
+                ok = reader.read_line(ans);
+            }
+            std::unique_lock<std::mutex> lk((ack_mut));
+            if(!ok || inflight.empty()){
+                // kv exited or answered out of turn, nobody waits forever.
+                if(!inflight.empty()){
+                    LOG_ERROR("kv pipe broken with %zu commands in flight\n", inflight.size());
+                }
+                broken = true;
+                ack_cv.notify_all();
+                return;
+            }
+            Pending pd = inflight.front();
+            lk.unlock();
+            if(pd.op == NUFT_SADD){
+                assert(config.nuft_text ? ans == "OK\n" : payload.empty());
+                loads.add(pd.i, pd.n);
+            }else if(config.nuft_text){
+                // printf("At get_parts(%lld) fread says %s\n", pd.i, ans.c_str());
+                parse_text_edges(ans, *pd.out);
+            }else{
+                pd.out->swap(payload);
+            }
+            lk.lock();
+            inflight.pop_front();
+            acked++;
+            ack_cv.notify_all();
+        }
+    }
+    bool wait_acked(uint64_t ticket){
+        // False if kv is gone before acknowledging the ticket.
+        std::unique_lock<std::mutex> lk((ack_mut));
+        ack_cv.wait(lk, [&](){ return acked >= ticket || broken; });
+        return acked >= ticket;
+    }
     std::vector<Partition> get_parts(){
-        std::lock_guard<std::mutex> guard((mut));
+        // All SGETs go out back to back, they see every SADD sent before them.
+        std::vector<std::vector<LL>> got(config.k);
+        uint64_t ticket = 0;
+        {
+            std::lock_guard<std::mutex> guard((write_mut));
+            for(P i = 0; i < config.k; i++){
+                ticket = submit(Pending{NUFT_SGET, i, 0, &got[i]});
+                if(!ticket){
+                    break;
+                }
+                if(!config.nuft_text){
+                    send_frame(NUFT_SGET, i, nullptr, 0);
+                }else{
+                    fprintf(proc->input(), "SGET P%lld\n", i);
+                    fflush(proc->input());
+                }
+            }
+        }
+        // Partial partitions would pass for the whole state, so there is no going on without kv.
+        if(!ticket || !wait_acked(ticket)){
+            LOG_FATAL("Can't get partitions, the kv pipe is broken\n");
+        }
         std::vector<Partition> res;
         res.resize(config.k);
         for(P i = 0; i < config.k; i++){
-            sprintf(buff, "SGET P%lld\n", i);
-
-            fprintf(proc->input(), "%s\n", buff);
-            fflush(proc->input());
-            auto ans = read_until(fileno(proc->output()), '\n');
-            // printf("At get_parts(%lld) fread says %s\n", i, ans.c_str());
-            printf("At get_parts(%lld) fread\n", i);
-            std::vector<std::string> ess = Nuke::split(ans, ";");
-            // printf("Split Res %d\n", ess.size());
-            for(auto && es: ess){
-                LL u, v;
-                if(~sscanf(es.c_str(), "%lld,%lld", &u, &v)){
-                    res[i].add_edge(Edge{u, v});
-                }
+            LOG_DEBUG("At get_parts(%lld) read %zu edges\n", i, got[i].size() / 2);
+            for(size_t j = 0; j + 1 < got[i].size(); j += 2){
+                res[i].add_edge(Edge{got[i][j], got[i][j + 1]});
             }
         }
         return res;
     }
+    void sync(){
+        if(!wait_all_acked()){
+            LOG_FATAL("kv pipe is broken, partitions sent to it may be lost\n");
+        }
+    }
+    bool wait_all_acked(){
+        // Returns once kv has acknowledged everything sent so far, false if it is gone.
+        uint64_t ticket;
+        {
+            std::lock_guard<std::mutex> guard((ack_mut));
+            ticket = sent;
+            if(broken){
+                return false;
+            }
+        }
+        return wait_acked(ticket);
+    }
+    PartitionLoads get_loads(){
+        return loads.snapshot();
+    }
     void put_verts(const Map<V, Vertex> & delta){
         for(auto && pr: delta){
             verts[pr.first].deg.fetch_add(pr.second.delta_deg);
-            for(auto p : pr.second.parts){
-                verts[pr.first].parts.insert(p);
-            }
+            verts[pr.first].parts.merge(pr.second.parts);
         }
     }
     void put_part(P i, const Partition & delta_part){
-        std::lock_guard<std::mutex> guard((mut));
-        std::string s;
-        s += "'";
-        int flag = 0;
+        // Returns once the command is written, its load is counted when kv acknowledges it.
+        // Once kv is gone nothing is written, the next sync() reports it.
         if(!delta_part.edges.size()){
             // printf("No edges, put_part() return\n");
             return;
         }
+        std::lock_guard<std::mutex> guard((write_mut));
+        if(!submit(Pending{NUFT_SADD, i, delta_part.edges.size(), nullptr})){
+            return;
+        }
+        if(!config.nuft_text){
+            packed.clear();
+            for(auto && edge: delta_part.edges){
+                packed.push_back(edge.u);
+                packed.push_back(edge.v);
+            }
+            send_frame(NUFT_SADD, i, packed.data(), packed.size() * sizeof(LL));
+            return;
+        }
+        std::string s = "SADD P" + std::to_string(i) + " '";
+        int flag = 0;
         for(auto && edge: delta_part.edges){
             if(flag){
-                sprintf(buff, ";%lld,%lld", edge.u, edge.v);
-            }else{
-                flag = 1;
-                sprintf(buff, "%lld,%lld", edge.u, edge.v);
+                s += ';';
             }
-            s += buff;
+            flag = 1;
+            s += std::to_string(edge.u);
+            s += ',';
+            s += std::to_string(edge.v);
         }
-        s += "'";
-        sprintf(buff, "SADD P%lld %s\n", i, s.c_str());
+        s += "'\n";
 
-        // printf("At put_part() write %u bytes: \n", strlen(buff));
-        fprintf(proc->input(), buff);
-        auto ans = read_until(fileno(proc->output()), '\n');
-        assert(ans == "OK\n");
+        // printf("At put_part() write %u bytes: \n", s.size());
+        fwrite(s.data(), 1, s.size(), proc->input());
+        fflush(proc->input());
     }
     void put_parts(const std::vector<Partition> & delta){
         assert(delta.size() == config.k);
@@ -160,36 +402,49 @@ public:
     }
     PartitionStateNuft(PartitionConfig c) : config(c){
         config.state = this;
-        FILE * f;
-        f = std::fopen(config.dataset.c_str(), "r");
-        LL u, v;
-        while(~fscanf(f, "%lld %lld\n", &u, &v)){
-            if(u != v){
-                edges.insert(Edge{u, v});
-                verts[u] = Vertex();
-                verts[v] = Vertex();
-            }
+        if(!edges.load(config.dataset)){
+            LOG_FATAL("Can't read %s\n", config.dataset.c_str());
+        }
+        for(const Edge & e: edges){
+            verts[e.u] = Vertex();
+            verts[e.v] = Vertex();
         }
-        std::fclose(f);
-        printf("Edges %u Vertexs %u\n", edges.size(), verts.size());
-        cursor = edges.begin();
+        LOG_INFO("Edges %zu Vertexs %zu\n", edges.size(), verts.size());
+        cursor = 0;
+        loads.reset(config.k);
+        inflight_cap = std::max(1, config.nuft_inflight);
 
         // pwrite = popen("./kv", "w");
         // fread = fopen("temp.swap", "r");
-        proc = new subprocess::Popen({"./kv"}, subprocess::input{subprocess::PIPE}, subprocess::output{subprocess::PIPE}, subprocess::error{stderr});
+        // Popen closes the child's error fd in this process once kv is started, so kv gets a copy of stderr.
+        proc = new subprocess::Popen(config.nuft_text ? "./kv" : "./kv --binary", subprocess::input{subprocess::PIPE}, subprocess::output{subprocess::PIPE}, subprocess::error{dup(fileno(stderr))});
+        reader = PipeReader(fileno(proc->output()));
+        acker = new std::thread(&PartitionStateNuft::ack_proc, this);
     }
     ~PartitionStateNuft(){
+        // Killing kv closes its stdout, which ends ack_proc.
         proc->kill();
+        acker->join();
+        delete acker;
         delete proc;
     }
+    size_t get_edges(size_t n, std::vector<Edge> & batch){
+        std::lock_guard<std::mutex> guard((mut));
+        size_t e = std::min(cursor + n, edges.size());
+        size_t got = cursor < e ? e - cursor : 0;
+        batch.insert(batch.end(), edges.begin() + cursor, edges.begin() + cursor + got);
+        cursor += got;
+        ei += got;
+        return got;
+    }
     Edge get_edge(bool & valid){
         std::lock_guard<std::mutex> guard((mut));
-        if(cursor != edges.end()){
+        if(cursor < edges.size()){
             valid = 1;
             ei ++;
-            return *(cursor++);
+            return edges[cursor++];
         }else{
-            printf("ei: %d\n", ei);
+            LOG_DEBUG("ei: %d\n", ei);
             valid = 0;
             return Edge{0, 0};
         }
@@ -20,6 +20,8 @@
 
 #pragma once
 #include "partition.h"
+#include "edge_store.h"
+#include "varint.h"
 #include <sstream>
 
 
@@ -69,7 +71,9 @@ struct HiRedisScanner{
 
                 }else{
                     for(int j = 0; j < reply->element[1]->elements; j++){
-                        cache.push_back(reply->element[1]->element[j]->str);
+                        // Members may be binary, see RedisLayout.
+                        redisReply * m = reply->element[1]->element[j];
+                        cache.push_back(std::string(m->str, m->len));
                     }
                 }
             }else if(reply->type == REDIS_REPLY_INTEGER){
@@ -89,91 +93,594 @@ struct HiRedisScanner{
     }
 };
 
+struct RedisPipeline{
+    // Queues commands with redisAppendCommandArgv and reads all their replies
+    // at once, so a batch of commands costs one round trip.
+    redisContext * conn;
+    size_t queued = 0;
+    std::vector<const char *> argv;
+    std::vector<size_t> argvlen;
+
+    RedisPipeline(redisContext * c) : conn(c){
+    }
+    ~RedisPipeline(){
+        flush();
+    }
+    void append(const std::vector<std::string> & args){
+        argv.clear();
+        argvlen.clear();
+        for(auto && a: args){
+            argv.push_back(a.data());
+            argvlen.push_back(a.size());
+        }
+        redisAppendCommandArgv(conn, argv.size(), argv.data(), argvlen.data());
+        queued++;
+    }
+    template<typename F>
+    void flush(F f){
+        // f(j, reply) is called for the j-th queued command, the reply is freed afterwards.
+        for(size_t j = 0; j < queued; j++){
+            redisReply * reply = nullptr;
+            if(redisGetReply(conn, (void **)&reply) != REDIS_OK){
+                // The connection is broken, the remaining replies are lost too.
+                break;
+            }
+            f(j, reply);
+            freeReplyObject(reply);
+        }
+        queued = 0;
+    }
+    void flush(){
+        flush([](size_t, redisReply *){});
+    }
+};
+
+struct RedisLayout{
+    // Compact Redis layout, version 2. Every key carries the version tag, so an
+    // older layout can live next to it while being migrated, see migrate_v1.
+    //   n2:E, n2:V       all edges and all vertices, packed members
+    //   n2:P<i>          edges of partition i, packed members
+    //   n2:PL<i>         load of partition i
+    //   n2:VB<v>         partitions related to v, bit p is set (SETBIT/BITFIELD)
+    //   n2:VD<b>         degrees, a big-endian i32 at BITFIELD offset #(v-1024b), b = floor(v/1024)
+    //   n2:Q             edges not in any partition yet, rebuilt on resume
+    //   nucut:layout     the version below, nucut:k and nucut:dataset name the run
+    // Members are packed as in Varint.
+    // Version 1 keys were E, V, P<i>, PL<i>, VP<v> (set of partitions) and VD<v>,
+    // with members in decimal "u,v", and had no nucut:layout.
+    static const int VERSION = 2;
+    static const LL VD_BUCKET = 1024;
+
+    static std::string key(const std::string & name){
+        return "n2:" + name;
+    }
+    static std::string edges(){
+        return key("E");
+    }
+    static std::string verts(){
+        return key("V");
+    }
+    static std::string part(P i){
+        return key("P" + std::to_string(i));
+    }
+    static std::string load(P i){
+        return key("PL" + std::to_string(i));
+    }
+    static std::string vert_parts(V v){
+        return key("VB" + std::to_string(v));
+    }
+    static LL deg_bucket(V v){
+        // Rounded down, so negative ids get a slot in [0, VD_BUCKET) too.
+        return v >= 0 ? v / VD_BUCKET : -((-(v + 1)) / VD_BUCKET) - 1;
+    }
+    static LL deg_slot(V v){
+        return v - deg_bucket(v) * VD_BUCKET;
+    }
+    static std::string vert_deg(V v){
+        return key("VD" + std::to_string(deg_bucket(v)));
+    }
+    static std::string deg_field(V v){
+        return "#" + std::to_string(deg_slot(v));
+    }
+    static LL deg_offset(V v){
+        return deg_slot(v) * 4;
+    }
+    static std::string pending(){
+        return key("Q");
+    }
+
+    static std::string pack_vert(V v){
+        std::string s;
+        Varint::put_vert(s, v);
+        return s;
+    }
+    static V unpack_vert(const char * p, size_t n){
+        return Varint::get_vert(p, p + n);
+    }
+    static std::string pack_edge(const Edge & e){
+        std::string s;
+        Varint::put_edge(s, e);
+        return s;
+    }
+    static Edge unpack_edge(const char * p, size_t n){
+        return Varint::get_edge(p, p + n);
+    }
+    static Edge unpack_edge(const redisReply * r){
+        return unpack_edge(r->str, r->len);
+    }
+    static void unpack_parts(const redisReply * r, Vertex & vert){
+        // Redis numbers bits from the most significant bit of the first byte.
+        if(r->type != REDIS_REPLY_STRING){
+            return;
+        }
+        for(size_t b = 0; b < r->len; b++){
+            uint8_t x = r->str[b];
+            while(x){
+                int j = __builtin_clz((unsigned)x) - 24;
+                vert.add_part(b * 8 + j);
+                x &= ~(0x80u >> j);
+            }
+        }
+    }
+
+    static LL unpack_deg(const redisReply * r){
+        // GETRANGE of v's 4 bytes. A bucket shorter than that has no v yet.
+        if(r->type != REDIS_REPLY_STRING || r->len < 4){
+            return 0;
+        }
+        uint32_t x = 0;
+        for(size_t b = 0; b < 4; b++){
+            x = x << 8 | (uint8_t)r->str[b];
+        }
+        return (int32_t)x;
+    }
+    static int stored(redisContext * conn){
+        // Layout of the state already in Redis, 0 if there is none.
+        redisReply * reply = (redisReply *)redisCommand(conn, "GET nucut:layout");
+        int ans = reply->type == REDIS_REPLY_STRING ? std::atoi(reply->str) : 0;
+        freeReplyObject(reply);
+        if(!ans){
+            reply = (redisReply *)redisCommand(conn, "EXISTS E");
+            ans = reply->type == REDIS_REPLY_INTEGER && reply->integer ? 1 : 0;
+            freeReplyObject(reply);
+        }
+        return ans;
+    }
+    static std::string stored_str(redisContext * conn, const char * name){
+        redisReply * reply = (redisReply *)redisCommand(conn, "GET %s", name);
+        std::string ans = reply->type == REDIS_REPLY_STRING ? std::string(reply->str, reply->len) : "";
+        freeReplyObject(reply);
+        return ans;
+    }
+
+    static void migrate_v1(redisContext * conn, int k, bool drop = true){
+        // Rewrites a version 1 state into version 2 keys, then drops the old keys.
+        RedisPipeline pipe(conn);
+        HiRedisScanner scanner;
+        auto copy_set = [&](const std::string & from, const std::string & to, std::function<std::string(const std::string &)> pack){
+            scanner.start_scan([&](int cur) -> redisReply*{
+                return (redisReply *)redisCommand(conn, "SSCAN %s %d COUNT 1000", from.c_str(), cur);
+            });
+            bool valid;
+            std::vector<std::string> args{"SADD", to};
+            while(1){
+                std::string m = scanner.get(valid);
+                if(valid){
+                    args.push_back(pack(m));
+                }
+                if(args.size() >= 2 + 1024 || (!valid && args.size() > 2)){
+                    // Flushed right away, the scanner shares the connection.
+                    pipe.append(args);
+                    pipe.flush();
+                    args.resize(2);
+                }
+                if(!valid){
+                    break;
+                }
+            }
+        };
+        auto pack_edge_str = [](const std::string & m){
+            LL u, v;
+            sscanf(m.c_str(), "%lld,%lld", &u, &v);
+            return pack_edge(Edge{u, v});
+        };
+        copy_set("E", edges(), pack_edge_str);
+        for(P i = 0; i < k; i++){
+            copy_set("P" + std::to_string(i), part(i), pack_edge_str);
+            redisReply * reply = (redisReply *)redisCommand(conn, "GET PL%lld", i);
+            if(reply->type == REDIS_REPLY_STRING){
+                pipe.append({"SET", load(i), std::string(reply->str, reply->len)});
+            }
+            freeReplyObject(reply);
+            if(drop){
+                pipe.append({"DEL", "PL" + std::to_string(i), "P" + std::to_string(i)});
+            }
+            pipe.flush();
+        }
+        // Vertices carry their partitions and degree along.
+        std::vector<V> vs;
+        copy_set("V", verts(), [&](const std::string & m){
+            vs.push_back(std::atoll(m.c_str()));
+            return pack_vert(vs.back());
+        });
+        for(size_t from = 0; from < vs.size(); from += 1024){
+            size_t to = std::min(vs.size(), from + 1024);
+            for(size_t j = from; j < to; j++){
+                pipe.append({"SMEMBERS", "VP" + std::to_string(vs[j])});
+                pipe.append({"GET", "VD" + std::to_string(vs[j])});
+            }
+            std::vector<std::vector<std::string>> writes;
+            pipe.flush([&](size_t j, redisReply * reply){
+                V v = vs[from + j / 2];
+                if(j % 2 == 0 && reply->elements){
+                    std::vector<std::string> args{"BITFIELD", vert_parts(v)};
+                    for(size_t e = 0; e < reply->elements; e++){
+                        args.insert(args.end(), {"SET", "u1", reply->element[e]->str, "1"});
+                    }
+                    writes.push_back(args);
+                }else if(j % 2 == 1 && reply->type == REDIS_REPLY_STRING){
+                    writes.push_back({"BITFIELD", vert_deg(v), "SET", "i32", deg_field(v), std::string(reply->str, reply->len)});
+                }
+            });
+            for(auto && w: writes){
+                pipe.append(w);
+            }
+            if(drop){
+                for(size_t j = from; j < to; j++){
+                    pipe.append({"DEL", "VP" + std::to_string(vs[j]), "VD" + std::to_string(vs[j])});
+                }
+            }
+            pipe.flush();
+        }
+        if(drop){
+            pipe.append({"DEL", "E", "V"});
+        }
+        pipe.append({"SET", "nucut:layout", std::to_string(VERSION)});
+        pipe.append({"SET", "nucut:k", std::to_string(k)});
+        pipe.flush();
+    }
+};
+
+struct RedisPool{
+    // One connection per calling thread, since a hiredis context is not thread-safe.
+    // Threads find their connection through a thread_local cache, so only the first
+    // call of each thread takes the lock.
+    std::string host;
+    int port;
+    uint64_t id;
+    std::mutex mut;
+    std::unordered_map<std::thread::id, redisContext *> conns;
+
+    static uint64_t next_id(){
+        static std::atomic<uint64_t> ids{1};
+        return ids.fetch_add(1);
+    }
+    RedisPool(const std::string & h, int p) : host(h), port(p), id(next_id()){
+    }
+    RedisPool(const RedisPool &) = delete;
+    RedisPool & operator=(const RedisPool &) = delete;
+    ~RedisPool(){
+        for(auto && pr: conns){
+            redisFree(pr.second);
+        }
+    }
+    redisContext * get(){
+        // Pools are told apart by id rather than address, which a later pool may reuse.
+        thread_local uint64_t cached_id = 0;
+        thread_local redisContext * cached = nullptr;
+        if(cached_id == id){
+            return cached;
+        }
+        std::lock_guard<std::mutex> guard((mut));
+        redisContext *& conn = conns[std::this_thread::get_id()];
+        if(!conn){
+            conn = redisConnect(host.c_str(), port);
+            assert(!(conn == NULL || conn->err));
+        }
+        cached_id = id;
+        cached = conn;
+        return conn;
+    }
+    size_t size(){
+        std::lock_guard<std::mutex> guard((mut));
+        return conns.size();
+    }
+};
+
 struct PartitionStateRedis : public PartitionState{
 protected:
     PartitionConfig config;
-    // Hiredis is not thread-safe
+    // Guards the edge scanner, everything else runs on the caller's own connection.
     mutable std::mutex mut;
-    redisContext * conn;
+    mutable RedisPool pool{"127.0.0.1", 6379};
+    // mutable RedisPool pool{"47.101.137.181", 6379};
     LL esize = 0, vsize = 0;
     HiRedisScanner scanner;
+    // The set edges are streamed from, all of n2:E unless resuming.
+    std::string stream = RedisLayout::edges();
     LL ei = 0;
+    // Most members in one variadic SADD.
+    static const size_t SADD_BATCH = 1024;
+
+    void put_parts(redisContext * conn, const std::vector<std::pair<P, const Partition *>> & delta){
+        // All SADDs go out in one pipeline, then the INCRBYs of the loads they changed in another.
+        RedisPipeline pipe(conn);
+        std::vector<P> owner;
+        std::vector<std::string> args;
+        for(auto && pr: delta){
+            const Partition & part = *pr.second;
+            size_t j = 0;
+            for(auto && edge: part.edges){
+                if(j % SADD_BATCH == 0){
+                    if(args.size()){
+                        pipe.append(args);
+                        owner.push_back(pr.first);
+                    }
+                    args = {"SADD", RedisLayout::part(pr.first)};
+                }
+                args.push_back(RedisLayout::pack_edge(edge));
+                j++;
+            }
+            if(args.size()){
+                pipe.append(args);
+                owner.push_back(pr.first);
+                args.clear();
+            }
+        }
+        std::map<P, LL> added;
+        pipe.flush([&](size_t j, redisReply * reply){
+            if(reply->type == REDIS_REPLY_INTEGER){
+                added[owner[j]] += reply->integer;
+            }
+        });
+        for(auto && pr: added){
+            if(pr.second){
+                pipe.append({"INCRBY", RedisLayout::load(pr.first), std::to_string(pr.second)});
+            }
+        }
+        pipe.flush();
+    }
+    // Members in one bulk SADD, and SADDs a bulk loader sends before reading replies.
+    static const size_t BULK_MEMBERS = 4096;
+    static const size_t BULK_BATCH = 64;
+
+    static void put_resp_bulk(std::string & out, const std::string & s){
+        out += '$';
+        out += std::to_string(s.size());
+        out += "\r\n";
+        out += s;
+        out += "\r\n";
+    }
+    void bulk_load(const EdgeStore & edges, int threads){
+        // Mass insertion. Each loader owns a slice of the edges and its own connection.
+        // It writes SADDs as raw RESP and keeps one batch in flight, so the server
+        // ingests a batch while the next one is being encoded. Reading a batch's
+        // replies is what pushes the next batch out.
+        // The connections are not taken from the pool: after an error they may still
+        // hold unread replies, so they are closed once the load is over.
+        size_t n = edges.size();
+        std::atomic<LL> errors{0};
+        std::vector<std::thread> ths;
+        for(int t = 0; t < threads; t++){
+            ths.emplace_back([&, t](){
+                redisContext * conn = redisConnect(pool.host.c_str(), pool.port);
+                if(conn == NULL || conn->err){
+                    LOG_ERROR("Bulk loader %d can't connect\n", t);
+                    errors++;
+                    redisFree(conn);
+                    return;
+                }
+                size_t from = n * t / threads, to = n * (t + 1) / threads;
+                size_t queued = 0, unread = 0;
+                std::vector<std::string> ms;
+                std::string cmd;
+                auto read_replies = [&](size_t cnt){
+                    for(size_t j = 0; j < cnt; j++){
+                        redisReply * reply = nullptr;
+                        if(redisGetReply(conn, (void **)&reply) != REDIS_OK){
+                            errors += cnt - j;
+                            return;
+                        }
+                        if(reply->type == REDIS_REPLY_ERROR){
+                            errors++;
+                        }
+                        freeReplyObject(reply);
+                    }
+                };
+                auto send = [&](const std::string & key){
+                    cmd.clear();
+                    cmd += '*';
+                    cmd += std::to_string(ms.size() + 2);
+                    cmd += "\r\n";
+                    put_resp_bulk(cmd, "SADD");
+                    put_resp_bulk(cmd, key);
+                    for(auto && m: ms){
+                        put_resp_bulk(cmd, m);
+                    }
+                    redisAppendFormattedCommand(conn, cmd.data(), cmd.size());
+                    ms.clear();
+                    if(++queued == BULK_BATCH){
+                        read_replies(unread);
+                        unread = queued;
+                        queued = 0;
+                    }
+                };
+                for(size_t b = from; b < to; b += BULK_MEMBERS){
+                    size_t e = std::min(to, b + BULK_MEMBERS);
+                    for(size_t i = b; i < e; i++){
+                        ms.push_back(RedisLayout::pack_edge(edges[i]));
+                    }
+                    send(RedisLayout::edges());
+                    // Edges are sorted by u, so runs of the same u are sent once.
+                    for(size_t i = b; i < e; i++){
+                        if(i == b || edges[i].u != edges[i - 1].u){
+                            ms.push_back(RedisLayout::pack_vert(edges[i].u));
+                        }
+                        ms.push_back(RedisLayout::pack_vert(edges[i].v));
+                    }
+                    send(RedisLayout::verts());
+                }
+                read_replies(unread + queued);
+                redisFree(conn);
+            });
+        }
+        for(auto && th: ths){
+            th.join();
+        }
+        if(errors){
+            // Stops before load() tags the layout, so a partial load is never resumed.
+            LOG_FATAL("Bulk load failed on %lld commands\n", errors.load());
+        }
+    }
+    void load(redisContext * conn){
+        freeReplyObject(redisCommand(conn, "FLUSHALL"));
+        // Edges come normalized, without self-loops, either parsed or mapped.
+        EdgeStore edges;
+        if(!edges.load(config.dataset)){
+            LOG_FATAL("Can't read %s\n", config.dataset.c_str());
+        }
+        uint64_t start_time = get_current_ms();
+        bulk_load(edges, std::max(1, config.loaders));
+        LOG_INFO("Load Finished in %llu ms\n", (unsigned long long)(get_current_ms() - start_time));
+        // Tagged last, so an interrupted load is not taken for a state to resume.
+        RedisPipeline pipe(conn);
+        pipe.append({"SET", "nucut:k", std::to_string(config.k)});
+        pipe.append({"SET", "nucut:dataset", config.dataset});
+        pipe.append({"SET", "nucut:layout", std::to_string(RedisLayout::VERSION)});
+    }
+    void rebuild_verts(redisContext * conn){
+        // A window's put_verts may have run without its put_parts, so vertex state
+        // is recounted from the partitions rather than trusted.
+        Map<V, Vertex> verts;
+        HiRedisScanner sc;
+        bool valid;
+        for(P i = 0; i < config.k; i++){
+            std::string key = RedisLayout::part(i);
+            sc.start_scan([&](int cur) -> redisReply*{
+                return (redisReply *)redisCommand(conn, "SSCAN %s %d COUNT 1000", key.c_str(), cur);
+            });
+            while(1){
+                std::string m = sc.get(valid);
+                if(!valid){
+                    break;
+                }
+                Edge e = RedisLayout::unpack_edge(m.data(), m.size());
+                for(V v: {e.u, e.v}){
+                    Vertex & vert = verts[v];
+                    vert.delta_deg++;
+                    vert.add_part(i);
+                }
+            }
+        }
+        std::set<std::string> old;
+        sc.start_scan([&](int cur) -> redisReply*{
+            return (redisReply *)redisCommand(conn, "SSCAN %s %d COUNT 1000", RedisLayout::verts().c_str(), cur);
+        });
+        while(1){
+            std::string m = sc.get(valid);
+            if(!valid){
+                break;
+            }
+            V v = RedisLayout::unpack_vert(m.data(), m.size());
+            old.insert(RedisLayout::vert_parts(v));
+            old.insert(RedisLayout::vert_deg(v));
+        }
+        RedisPipeline pipe(conn);
+        std::vector<std::string> args{"DEL"};
+        for(auto && key: old){
+            args.push_back(key);
+            if(args.size() > SADD_BATCH){
+                pipe.append(args);
+                args.resize(1);
+            }
+        }
+        if(args.size() > 1){
+            pipe.append(args);
+        }
+        pipe.flush();
+        put_verts(verts);
+    }
+    void resume(redisContext * conn){
+        rebuild_verts(conn);
+        // Edges already in some partition are not streamed again.
+        std::vector<std::string> args{"SDIFFSTORE", RedisLayout::pending(), RedisLayout::edges()};
+        for(P i = 0; i < config.k; i++){
+            args.push_back(RedisLayout::part(i));
+        }
+        RedisPipeline pipe(conn);
+        pipe.append(args);
+        pipe.flush([&](size_t, redisReply * reply){
+            LOG_INFO("Resuming, %lld edges left\n", reply->type == REDIS_REPLY_INTEGER ? reply->integer : 0LL);
+        });
+        stream = RedisLayout::pending();
+    }
 public:
+    size_t get_edges(size_t n, std::vector<Edge> & batch){
+        // One SSCAN member at a time, under one lock for the batch.
+        std::lock_guard<std::mutex> guard((mut));
+        return get_edges_locked(*this, guard, n, batch);
+    }
     std::set<Edge> get_edges() const{
         // TODO NOT IMPL!!
-        std::lock_guard<std::mutex> guard((mut));
+        redisContext * conn = pool.get();
         std::set<Edge> res;
-        redisReply * reply = redisCommand(conn, "SMEMBERS E");
+        redisReply * reply = redisCommand(conn, "SMEMBERS %s", RedisLayout::edges().c_str());
         for(int j = 0; j < reply->elements; j++){
-            LL u, v;
-            sscanf(reply->element[j]->str, "%lld,%lld", &u, &v);
-            res.insert(Edge{u, v});
+            res.insert(RedisLayout::unpack_edge(reply->element[j]));
         }
         freeReplyObject(reply);
         return res;
     }
     int edges_size() const{
-        std::lock_guard<std::mutex> guard((mut));
-        redisReply * reply = redisCommand(conn, "SCARD E");
+        redisContext * conn = pool.get();
+        redisReply * reply = redisCommand(conn, "SCARD %s", RedisLayout::edges().c_str());
         int ans = reply->integer;
         freeReplyObject(reply);
         return ans;
     }
     int verts_size() const{
-        std::lock_guard<std::mutex> guard((mut));
-        redisReply * reply = redisCommand(conn, "SCARD V");
+        redisContext * conn = pool.get();
+        redisReply * reply = redisCommand(conn, "SCARD %s", RedisLayout::verts().c_str());
         int ans = reply->integer;
         freeReplyObject(reply);
         return ans;
     }
-    Map<V, Vertex> get_verts(std::lock_guard<std::mutex> & guard, const Set<V> & vs){
+    Map<V, Vertex> get_verts(redisContext * conn, const Set<V> & vs){
+        // GET VB<v> and GETRANGE of v's degree for the whole window go out in one pipeline,
+        // replies come back in order, two per vertex.
         Map<V, Vertex> res;
+        RedisPipeline pipe(conn);
+        std::vector<Vertex *> order;
+        order.reserve(vs.size());
         for(auto v : vs){
-            res[v] = Vertex{};
-
-            redisReply * reply;
-            reply = redisCommand(conn, "SMEMBERS VP%lld", v);
-            // All partitions related to v
-            for(int j = 0; j < reply->elements; j++){
-                if(reply->element[j]->type == REDIS_REPLY_STRING){
-                    char * pstr = reply->element[j]->str;
-                    assert(pstr);
-                    res[v].add_part(std::atoi(pstr));
-                }else{
-                    assert(reply->element[j]->type == REDIS_REPLY_ARRAY);
-                    for(int j1 = 0; j1 < reply->element[j]->elements; j1++){
-                        char * pstr = reply->element[j]->element[j1]->str;
-                        assert(pstr);
-                        res[v].add_part(std::atoi(pstr));
-                    }
-                }
-            }
-            freeReplyObject(reply);
-            // v's degree
-            reply = redisCommand(conn, "GET VD%lld", v);
-            if(reply->str){
-                res[v].deg.store(std::atoi(reply->str));
+            pipe.append({"GET", RedisLayout::vert_parts(v)});
+            LL off = RedisLayout::deg_offset(v);
+            pipe.append({"GETRANGE", RedisLayout::vert_deg(v), std::to_string(off), std::to_string(off + 3)});
+            order.push_back(&res[v]);
+        }
+        pipe.flush([&](size_t j, redisReply * reply){
+            Vertex & vert = *order[j / 2];
+            if(j % 2 == 0){
+                // All partitions related to v
+                RedisLayout::unpack_parts(reply, vert);
             }else{
-                res[v].deg.store(0);
+                // v's degree
+                vert.deg.store(RedisLayout::unpack_deg(reply));
             }
-            freeReplyObject(reply);
-        }
+        });
         return res;
     }
     Map<V, Vertex> get_verts(const Set<V> & vs){
-        std::lock_guard<std::mutex> guard((mut));
-        return get_verts(guard, vs);
+        return get_verts(pool.get(), vs);
     }
     Map<V, Vertex> get_verts(){
-        std::lock_guard<std::mutex> guard((mut));
+        redisContext * conn = pool.get();
         Set<V> req;
-        redisReply * reply = redisCommand(conn, "SMEMBERS V");
+        redisReply * reply = redisCommand(conn, "SMEMBERS %s", RedisLayout::verts().c_str());
         for(int j = 0; j < reply->elements; j++){
-            LL v;
-            sscanf(reply->element[j]->str, "%lld", &v);
-            req.insert(v);
+            req.insert(RedisLayout::unpack_vert(reply->element[j]->str, reply->element[j]->len));
         }
-        auto ans = get_verts(guard, req);
+        auto ans = get_verts(conn, req);
         freeReplyObject(reply);
         return ans;
     }
@@ -181,25 +688,18 @@ public:
         return false;
     }
     std::vector<Partition> get_parts(){
-        std::lock_guard<std::mutex> guard((mut));
+        redisContext * conn = pool.get();
         redisReply * reply;
         std::vector<Partition> res;
         res.resize(config.k);
         for(P i = 0; i < config.k; i++){
-            redisReply * reply = redisCommand(conn, "SCARD P%lld", i);
-            int ans = reply->integer;
-            freeReplyObject(reply);
-            reply = redisCommand(conn, "SMEMBERS P%lld", i);
+            reply = redisCommand(conn, "SMEMBERS %s", RedisLayout::part(i).c_str());
             for(int j = 0; j < reply->elements; j++){
                 if(reply->element[j]->type == REDIS_REPLY_STRING){
-                    LL u, v;
-                    sscanf(reply->element[j]->str, "%lld,%lld", &u, &v);
-                    res[i].add_edge(Edge{u, v});
+                    res[i].add_edge(RedisLayout::unpack_edge(reply->element[j]));
                 }else if(reply->element[j]->type == REDIS_REPLY_ARRAY){
                     for(int j1 = 0; j1 < reply->element[j]->elements; j1++){
-                        LL u, v;
-                        sscanf(reply->element[j]->element[j1]->str, "%lld,%lld", &u, &v);
-                        res[i].add_edge(Edge{u, v});
+                        res[i].add_edge(RedisLayout::unpack_edge(reply->element[j]->element[j1]));
                     }
                 }
             }
@@ -207,36 +707,66 @@ public:
         }
         return res;
     }
+    PartitionLoads get_loads(){
+        // Loads are kept in PL<i> counters, so one MGET reads them all.
+        redisContext * conn = pool.get();
+        std::vector<std::string> keys;
+        std::vector<const char *> argv;
+        argv.push_back("MGET");
+        for(P i = 0; i < config.k; i++){
+            keys.push_back(RedisLayout::load(i));
+        }
+        for(auto && key: keys){
+            argv.push_back(key.c_str());
+        }
+        PartitionLoads res;
+        res.resize(config.k);
+        redisReply * reply = (redisReply *)redisCommandArgv(conn, argv.size(), argv.data(), nullptr);
+        for(int j = 0; j < reply->elements && j < config.k; j++){
+            if(reply->element[j]->type == REDIS_REPLY_STRING){
+                res.load[j] = std::atoll(reply->element[j]->str);
+            }
+        }
+        res.build();
+        freeReplyObject(reply);
+        return res;
+    }
     void put_verts(const Map<V, Vertex> & delta){
-        std::lock_guard<std::mutex> guard((mut));
+        RedisPipeline pipe(pool.get());
+        std::vector<std::string> args;
         for(auto && pr: delta){
-            redisReply * reply;
+            V v = pr.first;
             // Increase v's degree
-            reply = redisCommand(conn, "INCRBY VD%lld %lld", pr.first, pr.second.delta_deg);
-            freeReplyObject(reply);
-            for(auto p : pr.second.parts){
-                // Update V's partition
-                reply = redisCommand(conn, "SADD VP%lld %lld", pr.first, p);
-                freeReplyObject(reply);
+            if(pr.second.delta_deg){
+                pipe.append({"BITFIELD", RedisLayout::vert_deg(v), "INCRBY", "i32", RedisLayout::deg_field(v), std::to_string(pr.second.delta_deg)});
+            }
+            // Update V's partitions, one BITFIELD sets all their bits
+            if(!pr.second.parts.empty()){
+                args = {"BITFIELD", RedisLayout::vert_parts(v)};
+                for(auto p : pr.second.parts){
+                    args.insert(args.end(), {"SET", "u1", std::to_string(p), "1"});
+                }
+                pipe.append(args);
             }
         }
-    }
-    void put_part(std::lock_guard<std::mutex> & guard, P i, const Partition & delta_part){
-        for(auto && edge: delta_part.edges){
-            redisReply * reply;
-            reply = redisCommand(conn, "SADD P%lld %lld,%lld", i, edge.u, edge.v);
-            freeReplyObject(reply);
-        }
+        pipe.flush();
     }
     void put_part(P i, const Partition & delta_part){
-        std::lock_guard<std::mutex> guard((mut));
-        put_part(guard, i, delta_part);
+        if(delta_part.edges.empty()){
+            return;
+        }
+        put_parts(pool.get(), {{i, &delta_part}});
     }
     void put_parts(const std::vector<Partition> & delta){
-        std::lock_guard<std::mutex> guard((mut));
         assert(delta.size() == config.k);
-        for(int i = 0; i < delta.size(); i++){
-            put_part(guard, i, delta[i]);
+        std::vector<std::pair<P, const Partition *>> changed;
+        for(P i = 0; i < delta.size(); i++){
+            if(!delta[i].edges.empty()){
+                changed.push_back({i, &delta[i]});
+            }
+        }
+        if(changed.size()){
+            put_parts(pool.get(), changed);
         }
     }
     void recover(std::lock_guard<std::mutex> & guard, const std::vector<Partition> & parts){
@@ -247,50 +777,52 @@ public:
     }
     PartitionStateRedis(PartitionConfig c) : config(c){
         config.state = this;
-        conn = redisConnect("127.0.0.1", 6379);
-        // conn = redisConnect("47.101.137.181", 6379);
-        assert(!(conn == NULL && conn->err));
-        freeReplyObject(redisCommand(conn, "FLUSHALL"));
-        
-        FILE * f;
-        f = std::fopen(config.dataset.c_str(), "r");
-        LL u, v;
-        redisReply * reply;
-        while(~fscanf(f, "%lld %lld\n", &u, &v)){
-            if(u != v){
-                if(u > v){
-                    std::swap(u, v);
-                }
-                // printf("Add\n");
-                reply = redisCommand(conn, "SADD E %lld,%lld", u, v);
-                freeReplyObject(reply);
-                reply = redisCommand(conn, "SADD V %lld", u);
-                freeReplyObject(reply);
-                reply = redisCommand(conn, "SADD V %lld", v);
-                freeReplyObject(reply);
+        redisContext * conn = pool.get();
+        int layout = config.redis_resume ? RedisLayout::stored(conn) : 0;
+        if(layout == 1){
+            LOG_INFO("Migrating Redis layout 1 to %d\n", RedisLayout::VERSION);
+            RedisLayout::migrate_v1(conn, config.k);
+            // Layout 1 did not name its dataset, it is taken to be this one.
+            RedisPipeline(conn).append({"SET", "nucut:dataset", config.dataset});
+            layout = RedisLayout::VERSION;
+        }
+        if(layout == 0){
+            if(config.redis_resume){
+                LOG_INFO("No state in Redis to resume, loading %s\n", config.dataset.c_str());
             }
+            load(conn);
+        }else if(layout != RedisLayout::VERSION){
+            LOG_FATAL("Redis holds layout %d, this build reads layout %d\n", layout, RedisLayout::VERSION);
+        }else if(RedisLayout::stored_str(conn, "nucut:k") != std::to_string(config.k)
+                || RedisLayout::stored_str(conn, "nucut:dataset") != config.dataset){
+            LOG_FATAL("Redis holds a run of %s with k = %s, not of %s with k = %d\n",
+                RedisLayout::stored_str(conn, "nucut:dataset").c_str(), RedisLayout::stored_str(conn, "nucut:k").c_str(),
+                config.dataset.c_str(), config.k);
+        }else{
+            resume(conn);
         }
-        printf("Load Finished\n");
 
         esize = edges_size();
         vsize = verts_size();
-        printf("Edges %u Vertexs %u\n", esize, vsize);
+        LOG_INFO("Edges %lld Vertexs %lld\n", esize, vsize);
 
-        scanner.start_scan([&](int cur) -> redisReply*{
-            return redisCommand(conn, "SSCAN E %d", cur);
+        scanner.start_scan([this](int cur) -> redisReply*{
+            // Called under mut, on whichever thread is taking edges.
+            return redisCommand(pool.get(), "SSCAN %s %d", stream.c_str(), cur);
         });
     }
     ~PartitionStateRedis() override{
-        redisFree(conn);
+        LOG_INFO("Redis connections %zu\n", pool.size());
     }
     Edge get_edge(bool & valid){
         std::lock_guard<std::mutex> guard((mut));
-        LL u, v;
+        return get_edge(guard, valid);
+    }
+    Edge get_edge(std::lock_guard<std::mutex> & guard, bool & valid){
         auto r = scanner.get(valid);
         if(valid){
             ei ++;
-            sscanf(r.c_str(), "%lld,%lld", &u, &v);
-            return Edge{u, v};
+            return RedisLayout::unpack_edge(r.data(), r.size());
         }else{
             return Edge{0, 0};
         }
@@ -0,0 +1,180 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+
+#include "test_util.h"
+#include "edge_store.h"
+#include "state_local.h"
+
+TEST(EdgeStore, TextBinaryTextRoundTrip){
+    std::vector<Edge> es = random_edges(5000, 3000, 1);
+    // Duplicates and reversed pairs fold into one edge.
+    es.push_back(Edge{es[0].v, es[0].u});
+    es.push_back(es[1]);
+    std::string txt = write_text_edges("rt.txt", es);
+    std::string bin = test_path("rt.bin"), txt2 = test_path("rt2.txt");
+    std::set<Edge> want(es.begin(), es.end());
+
+    EdgeStore a;
+    ASSERT_TRUE(a.load(txt));
+    EXPECT_FALSE(a.is_mapped());
+    EXPECT_EQ(a.to_set(), want);
+    ASSERT_TRUE(a.write_binary(bin));
+
+    EXPECT_FALSE(EdgeStore::is_binary(txt));
+    ASSERT_TRUE(EdgeStore::is_binary(bin));
+    EdgeStore b;
+    ASSERT_TRUE(b.load(bin));
+    EXPECT_TRUE(b.is_mapped());
+    ASSERT_EQ(b.size(), want.size());
+    // Served in the order they were written, sorted.
+    EXPECT_TRUE(std::equal(a.begin(), a.end(), b.begin()));
+    EXPECT_TRUE(std::is_sorted(b.begin(), b.end()));
+    ASSERT_TRUE(b.write_text(txt2));
+
+    EdgeStore c;
+    ASSERT_TRUE(c.load(txt2));
+    EXPECT_EQ(c.to_set(), want);
+}
+
+TEST(EdgeStore, RejectsDamagedBinary){
+    std::string txt = write_text_edges("dmg.txt", random_edges(100, 50, 2));
+    EdgeStore a;
+    ASSERT_TRUE(a.load(txt));
+    std::string bin = test_path("dmg.bin");
+    ASSERT_TRUE(a.write_binary(bin));
+
+    // One edge short of what the header promises.
+    std::string cut = test_path("cut.bin");
+    {
+        FILE * in = std::fopen(bin.c_str(), "rb");
+        FILE * out = std::fopen(cut.c_str(), "wb");
+        std::vector<char> buf(sizeof(EdgeFileHeader) + 99 * sizeof(Edge));
+        ASSERT_EQ(std::fread(buf.data(), 1, buf.size(), in), buf.size());
+        std::fwrite(buf.data(), 1, buf.size(), out);
+        std::fclose(in);
+        std::fclose(out);
+    }
+    EdgeStore b;
+    EXPECT_TRUE(EdgeStore::is_binary(cut));
+    EXPECT_FALSE(b.open_binary(cut));
+    EXPECT_EQ(b.size(), 0);
+
+    // Another version.
+    {
+        FILE * f = std::fopen(bin.c_str(), "r+b");
+        uint32_t version = EDGE_FILE_VERSION + 1;
+        std::fseek(f, offsetof(EdgeFileHeader, version), SEEK_SET);
+        std::fwrite(&version, sizeof version, 1, f);
+        std::fclose(f);
+    }
+    EXPECT_FALSE(b.open_binary(bin));
+    EXPECT_FALSE(b.open_binary(test_path("missing.bin")));
+}
+
+TEST(EdgeStoreDeathTest, LocalStateRefusesDamagedBinary){
+    testing::FLAGS_gtest_death_test_style = "threadsafe";
+    std::string bin = test_path("bad.bin");
+    FILE * f = std::fopen(bin.c_str(), "wb");
+    EdgeFileHeader h;
+    std::memcpy(h.magic, EDGE_FILE_MAGIC, sizeof h.magic);
+    h.version = EDGE_FILE_VERSION;
+    h.flags = 0;
+    h.count = 10;
+    h.reserved = 0;
+    std::fwrite(&h, sizeof h, 1, f);
+    std::fclose(f);
+    DebugStruct ds;
+    EXPECT_DEATH({
+        PartitionStateLocal st(test_config(bin, 2, ds));
+    }, "Can't map binary edge list");
+}
+
+TEST(EdgeStore, LazyEdgesSizeCountsRepeatsOnce){
+    std::vector<Edge> es = random_edges(300, 100, 3);
+    std::vector<Edge> with_repeats = es;
+    for(size_t i = 0; i < 50; i++){
+        with_repeats.push_back(es[i * 3]);
+    }
+    DebugStruct ds;
+    PartitionConfig c = test_config(write_text_edges("lazy.txt", with_repeats), 2, ds);
+    c.lazy_load = true;
+    PartitionStateLocal st(c);
+    EXPECT_EQ(st.edges_size(), 0);
+    std::vector<Edge> batch;
+    while(st.get_edges(64, batch)){
+    }
+    EXPECT_EQ(st.edges_size(), es.size());
+    EXPECT_EQ(st.edges_size(), es.size());
+}
+
+TEST(EdgeParser, MatchesScanfOnAllThreadCounts){
+    // Values of every SWAR length class, negatives, CRLF, comments, tabs,
+    // malformed lines and self-loops, and a last line without a newline.
+    std::mt19937_64 rng(31);
+    auto value = [&](){
+        static const int DIGITS[] = {1, 3, 7, 8, 9, 15, 16, 17, 18};
+        int d = DIGITS[rng() % 9];
+        LL x = 1 + rng() % 9;
+        for(int j = 1; j < d; j++){
+            x = x * 10 + rng() % 10;
+        }
+        return rng() % 4 ? x : -x;
+    };
+    std::string text;
+    for(int line = 0; line < 5000; line++){
+        int kind = rng() % 20;
+        if(kind == 0){
+            text += "# a comment 1 2";
+        }else if(kind == 1){
+            text += "foo bar";
+        }else if(kind == 2){
+            LL x = value();
+            text += std::to_string(x) + " " + std::to_string(x);
+        }else{
+            text += std::to_string(value()) + (kind == 3 ? "\t" : " ") + std::to_string(value());
+        }
+        text += rng() % 3 ? "\n" : "\r\n";
+        if(kind == 4){
+            // Duplicates across chunks.
+            text += text.substr(0, text.find('\n') + 1);
+        }
+    }
+    text += std::to_string(value()) + " " + std::to_string(value());
+
+    std::set<Edge> want;
+    size_t at = 0;
+    while(at < text.size()){
+        size_t nl = text.find('\n', at);
+        std::string line = text.substr(at, nl == std::string::npos ? std::string::npos : nl - at);
+        at = nl == std::string::npos ? text.size() : nl + 1;
+        LL u, v;
+        if(line[0] != '#' && std::sscanf(line.c_str(), "%lld %lld", &u, &v) == 2 && u != v){
+            want.insert(Edge{u, v});
+        }
+    }
+    ASSERT_GT(want.size(), 4000);
+    for(int threads: {1, 2, 3, 8}){
+        std::vector<Edge> got = EdgeParser::parse(text.data(), text.data() + text.size(), threads, 0);
+        EXPECT_EQ(std::set<Edge>(got.begin(), got.end()), want) << threads << " threads";
+        EXPECT_EQ(got.size(), want.size()) << threads << " threads";
+        EXPECT_TRUE(std::is_sorted(got.begin(), got.end())) << threads << " threads";
+    }
+}
@@ -0,0 +1,165 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+
+#include "test_util.h"
+#include "state_nuft.h"
+#include <unistd.h>
+#include <thread>
+#include <csignal>
+#include <sys/stat.h>
+
+TEST(PipeReader, LinesSpanningReads){
+    // Written in small pieces, so most lines are cut across reads. Short lines must
+    // not grow the buffer however much is streamed, a line longer than it must.
+    const size_t chunk = PipeReader::CHUNK;
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    std::vector<std::string> lines;
+    std::mt19937 gen(3);
+    for(int i = 0; i < 20000; i++){
+        lines.push_back(std::string(gen() % 3000, 'a' + i % 26) + "\n");
+    }
+    lines.push_back(std::string(5 * chunk, 'z') + "\n");
+    lines.push_back("last");
+    std::thread writer([&](){
+        std::string all;
+        for(auto && l: lines){
+            all += l;
+        }
+        for(size_t i = 0; i < all.size(); i += 700){
+            size_t n = std::min((size_t)700, all.size() - i);
+            ASSERT_EQ(write(fds[1], all.data() + i, n), (ssize_t)n);
+        }
+        close(fds[1]);
+    });
+    PipeReader r(fds[0]);
+    std::string line;
+    for(size_t i = 0; i + 2 < lines.size(); i++){
+        ASSERT_TRUE(r.read_line(line));
+        ASSERT_EQ(line, lines[i]) << i;
+        ASSERT_EQ(r.buf.size(), chunk) << i;
+    }
+    ASSERT_TRUE(r.read_line(line));
+    EXPECT_EQ(line, lines[lines.size() - 2]);
+    EXPECT_GT(r.buf.size(), 5 * chunk);
+    // No terminator before EOF, so no line.
+    EXPECT_FALSE(r.read_line(line));
+    writer.join();
+    close(fds[0]);
+}
+
+// Talks to ./kv, as PartitionStateNuft does, so these are skipped where kv is not built.
+// The binary protocol also needs NUCUT_KV_BINARY set, since older kv builds lack --binary.
+static void round_trip(bool text, int inflight){
+    if(access("./kv", X_OK) != 0){
+        GTEST_SKIP() << "./kv not built";
+    }
+    if(!text && !std::getenv("NUCUT_KV_BINARY")){
+        GTEST_SKIP() << "NUCUT_KV_BINARY not set";
+    }
+    std::vector<Edge> es = random_edges(3000, 500, 7);
+    DebugStruct ds;
+    PartitionConfig c = test_config(write_text_edges("nuft.txt", es), 3, ds);
+    c.nuft_text = text;
+    c.nuft_inflight = inflight;
+    PartitionStateNuft st(c);
+
+    std::vector<std::set<Edge>> want(3);
+    std::vector<Partition> delta(3);
+    for(size_t j = 0; j < es.size(); j++){
+        // Large edge ids too, they must survive both encodings.
+        Edge e{es[j].u + (1ll << 40), es[j].v};
+        delta[j % 3].add_edge(e);
+        want[j % 3].insert(e);
+        if(j % 500 == 499){
+            st.put_parts(delta);
+            delta.assign(3, Partition());
+        }
+    }
+    st.put_part(2, Partition());
+    st.sync();
+
+    std::vector<Partition> got = st.get_parts();
+    ASSERT_EQ(got.size(), 3);
+    PartitionLoads loads = st.get_loads();
+    for(P i = 0; i < 3; i++){
+        std::set<Edge> g;
+        for(const Edge & e: got[i].edges){
+            g.insert(e);
+        }
+        EXPECT_EQ(g, want[i]) << "partition " << i;
+        EXPECT_EQ(loads.load[i], want[i].size());
+    }
+}
+
+TEST(PartitionStateNuft, RoundTripText){
+    round_trip(true, 4);
+}
+
+TEST(PartitionStateNuft, RoundTripWithoutPipelining){
+    // 0 is taken as 1, one command at a time.
+    round_trip(true, 0);
+}
+
+TEST(PartitionStateNuft, RoundTripBinary){
+    round_trip(false, 4);
+}
+
+// A kv that takes one command and exits without answering it.
+static std::string dead_kv_dir(){
+    std::string dir = test_path("dead_kv");
+    mkdir(dir.c_str(), 0755);
+    std::string kv = dir + "/kv";
+    FILE * f = std::fopen(kv.c_str(), "w");
+    std::fprintf(f, "#!/bin/sh\nread line\nexit 0\n");
+    std::fclose(f);
+    chmod(kv.c_str(), 0755);
+    return dir;
+}
+
+TEST(PartitionStateNuft, DeadKvFailsSync){
+    testing::FLAGS_gtest_death_test_style = "threadsafe";
+    std::string dir = dead_kv_dir();
+    DebugStruct ds;
+    PartitionConfig c = test_config(write_text_edges("dead_kv.txt", random_edges(100, 50, 3)), 2, ds);
+    EXPECT_DEATH({
+        ASSERT_EQ(chdir(dir.c_str()), 0);
+        PartitionStateNuft st(c);
+        Partition p;
+        p.add_edge(Edge{1, 2});
+        st.put_part(0, p);
+        st.sync();
+    }, "kv pipe is broken");
+}
+
+TEST(PartitionStateNuft, DeadKvFailsGetParts){
+    testing::FLAGS_gtest_death_test_style = "threadsafe";
+    std::string dir = dead_kv_dir();
+    DebugStruct ds;
+    PartitionConfig c = test_config(write_text_edges("dead_kv.txt", random_edges(100, 50, 3)), 2, ds);
+    EXPECT_DEATH({
+        // Later SGETs may be written after kv is gone.
+        std::signal(SIGPIPE, SIG_IGN);
+        ASSERT_EQ(chdir(dir.c_str()), 0);
+        PartitionStateNuft st(c);
+        st.get_parts();
+    }, "Can't get partitions");
+}
@@ -0,0 +1,130 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+
+#include <gtest/gtest.h>
+#include "partition_def.h"
+#include <random>
+
+TEST(VertexDict, DenseInOrderOfFirstSight){
+    VertexDict dict;
+    std::vector<V> raw = {1ll << 40, 7, -3, 1ll << 40, 123456789012ll, 7};
+    std::vector<VI> want = {0, 1, 2, 0, 3, 1};
+    for(size_t i = 0; i < raw.size(); i++){
+        EXPECT_EQ(dict.intern(raw[i]), want[i]);
+    }
+    EXPECT_EQ(dict.size(), 4);
+    VI i;
+    ASSERT_TRUE(dict.find(123456789012ll, i));
+    EXPECT_EQ(i, 3);
+    EXPECT_FALSE(dict.find(8, i));
+    for(VI j = 0; j < dict.size(); j++){
+        VI back;
+        ASSERT_TRUE(dict.find(dict.to_raw(j), back));
+        EXPECT_EQ(back, j);
+    }
+}
+
+TEST(PartSet, AboveSixtyFourPartitions){
+    PartSet s;
+    std::set<P> want = {0, 5, 63, 64, 65, 127, 128, 200, 255};
+    for(P p: want){
+        s.insert(p);
+    }
+    // Inserting twice changes nothing.
+    s.insert(64);
+    EXPECT_EQ(s.size(), want.size());
+    for(P p = 0; p < 300; p++){
+        EXPECT_EQ(s.contains(p), want.count(p) > 0) << p;
+    }
+    std::set<P> got;
+    for(P p: s){
+        got.insert(p);
+    }
+    EXPECT_EQ(got, want);
+    // Words past the last one are simply absent.
+    EXPECT_EQ(s.bits(100), 0);
+    EXPECT_FALSE(s.contains(1000));
+}
+
+TEST(PartSet, MergeGrowsToTheWiderSet){
+    PartSet a, b;
+    a.insert(3);
+    b.insert(70);
+    b.insert(190);
+    a.merge(b);
+    EXPECT_EQ(a.size(), 3);
+    EXPECT_TRUE(a.contains(3));
+    EXPECT_TRUE(a.contains(70));
+    EXPECT_TRUE(a.contains(190));
+    // The narrower side keeps its words.
+    b.merge(PartSet());
+    EXPECT_EQ(b.size(), 2);
+    a.clear();
+    EXPECT_TRUE(a.empty());
+    EXPECT_FALSE(a.begin() != a.end());
+}
+
+TEST(PartitionLoads, TournamentTreeFollowsUpdates){
+    std::mt19937 rng(7);
+    for(size_t k: {1, 2, 5, 8, 13, 64, 100}){
+        PartitionLoads loads;
+        loads.resize(k);
+        std::vector<LL> want(k, 0);
+        for(int round = 0; round < 2000; round++){
+            P p = rng() % k;
+            LL n = (LL)(rng() % 7) - 2;
+            loads.add(p, n);
+            want[p] += n;
+            ASSERT_EQ(loads.max(), *std::max_element(want.begin(), want.end())) << "k " << k;
+            ASSERT_EQ(loads.min(), *std::min_element(want.begin(), want.end())) << "k " << k;
+        }
+        for(P p = 0; p < k; p++){
+            EXPECT_EQ(loads[p], want[p]);
+        }
+    }
+}
+
+TEST(PartitionLoads, BuildAfterDirectWrites){
+    PartitionLoads loads;
+    loads.resize(6);
+    loads.load = {4, 9, 1, 9, 3, 2};
+    loads.build();
+    EXPECT_EQ(loads.max(), 9);
+    EXPECT_EQ(loads.min(), 1);
+    loads.add(2, 10);
+    EXPECT_EQ(loads.max(), 11);
+    EXPECT_EQ(loads.min(), 2);
+}
+
+TEST(Partition, ContainsBuildsTheIndexOnFirstUse){
+    Partition p;
+    p.add_edge(Edge{1, 2});
+    p.add_edge(Edge{3, 2});
+    EXPECT_FALSE(p.indexed);
+    EXPECT_TRUE(p.contains(Edge{2, 3}));
+    EXPECT_FALSE(p.contains(Edge{1, 3}));
+    EXPECT_TRUE(p.indexed);
+    // From then on add_edge dedupes, and the index follows new edges.
+    p.add_edge(Edge{2, 1});
+    p.add_edge(Edge{4, 5});
+    EXPECT_EQ(p.edges.size(), 3);
+    EXPECT_TRUE(p.contains(Edge{4, 5}));
+}
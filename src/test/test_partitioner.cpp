@@ -0,0 +1,83 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+
+#include "test_util.h"
+#include "state_local.h"
+#include "heuristic.h"
+#include "partition_async.h"
+
+namespace{
+template<typename M>
+void expect_every_edge_once(PartitionConfig c, const std::vector<Edge> & es){
+    PartitionStateLocal st(c);
+    c.state = &st;
+    M m(c);
+    m.run();
+    m.join();
+    std::map<Edge, int> seen;
+    std::vector<Partition> parts = st.get_parts();
+    ASSERT_EQ(parts.size(), c.k);
+    LL total = 0;
+    PartitionLoads loads = st.get_loads();
+    for(P i = 0; i < c.k; i++){
+        EXPECT_EQ(loads[i], parts[i].edges.size());
+        for(const Edge & e: parts[i].edges){
+            seen[e]++;
+        }
+        total += parts[i].edges.size();
+    }
+    EXPECT_EQ(total, es.size());
+    for(const Edge & e: es){
+        EXPECT_EQ(seen[e], 1) << e.to_string();
+    }
+}
+
+P first_partition(const Vertex & u, const Vertex & v, const PartitionLoads & loads){
+    return 0;
+}
+}
+
+class PartitionerTest : public testing::Test{
+protected:
+    DebugStruct ds;
+    std::vector<Edge> es = random_edges(3000, 800, 9);
+    PartitionConfig c;
+    void SetUp() override{
+        ds.f = std::fopen(test_path("partitioner.out").c_str(), "w");
+        c = test_config(write_text_edges("partitioner.txt", es), 8, ds);
+        c.subp = 3;
+    }
+    void TearDown() override{
+        std::fclose(ds.f);
+    }
+};
+
+TEST_F(PartitionerTest, StaticPolicies){
+    expect_every_edge_once<MajorPartitioner<HdrfHeuristic>>(c, es);
+    expect_every_edge_once<MajorPartitioner<GreedyHeuristic>>(c, es);
+    expect_every_edge_once<MajorPartitionerAsync<MixedHeuristic>>(c, es);
+}
+
+TEST_F(PartitionerTest, UserPolicy){
+    expect_every_edge_once<MajorPartitioner<UserHeuristic<first_partition>>>(c, es);
+    c.hf = first_partition;
+    expect_every_edge_once<MajorPartitionerAsync<DynamicHeuristic>>(c, es);
+}
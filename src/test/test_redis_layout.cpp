@@ -0,0 +1,64 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+
+#include "test_util.h"
+#include "state_redis.h"
+
+TEST(RedisLayout, DegreeSlotsOfNegativeIds){
+    // Every id gets its own slot in [0, 1024) of exactly one bucket.
+    const LL bucket = RedisLayout::VD_BUCKET;
+    std::set<std::string> seen;
+    for(V v = -3000; v < 3000; v++){
+        LL slot = RedisLayout::deg_slot(v);
+        ASSERT_GE(slot, 0) << v;
+        ASSERT_LT(slot, bucket) << v;
+        EXPECT_EQ(RedisLayout::deg_bucket(v) * bucket + slot, v);
+        EXPECT_EQ(RedisLayout::deg_offset(v), slot * 4);
+        EXPECT_TRUE(seen.insert(RedisLayout::vert_deg(v) + RedisLayout::deg_field(v)).second) << v;
+    }
+    EXPECT_EQ(RedisLayout::vert_deg(-1), "n2:VD-1");
+    EXPECT_EQ(RedisLayout::deg_field(-1), "#1023");
+    EXPECT_EQ(RedisLayout::deg_field(-1024), "#0");
+    EXPECT_EQ(RedisLayout::vert_deg(-1025), "n2:VD-2");
+    for(V v: {std::numeric_limits<V>::min(), std::numeric_limits<V>::max()}){
+        LL slot = RedisLayout::deg_slot(v);
+        EXPECT_TRUE(slot >= 0 && slot < bucket) << v;
+    }
+}
+
+TEST(RedisLayout, UnpackDegree){
+    redisReply r{};
+    r.type = REDIS_REPLY_STRING;
+    char bytes[4] = {(char)0xff, (char)0xff, (char)0xff, (char)0xfe};
+    r.str = bytes;
+    r.len = 4;
+    EXPECT_EQ(RedisLayout::unpack_deg(&r), -2);
+    bytes[0] = 0;
+    bytes[1] = 1;
+    bytes[2] = 0;
+    bytes[3] = 2;
+    EXPECT_EQ(RedisLayout::unpack_deg(&r), 65538);
+    // Past the end of the bucket, the vertex has no degree yet.
+    r.len = 0;
+    EXPECT_EQ(RedisLayout::unpack_deg(&r), 0);
+    r.type = REDIS_REPLY_NIL;
+    EXPECT_EQ(RedisLayout::unpack_deg(&r), 0);
+}
@@ -0,0 +1,92 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+
+#include <gtest/gtest.h>
+#include "score_kernel.h"
+#include <random>
+
+namespace{
+P argmax_reference(const ScoreParams & sp, const std::vector<LL> & load, const PartSet & u, const PartSet & v){
+    // The scores as heuristic.h used to take them: first partition with the highest score.
+    std::vector<double> s = score_partitions(sp, load.data(), u, v, load.size());
+    return std::max_element(s.begin(), s.end()) - s.begin();
+}
+
+std::vector<std::pair<const char *, ScoreKernel>> kernels_here(){
+    std::vector<std::pair<const char *, ScoreKernel>> ks{{"scalar", score_argmax_fallback}};
+    #if defined(NUCUT_X86_KERNELS)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        ks.push_back({"avx2", score_argmax_avx2});
+    }
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")){
+        ks.push_back({"avx512", score_argmax_avx512});
+    }
+    #endif
+    return ks;
+}
+}
+
+TEST(ScoreKernel, VectorKernelsMatchScalar){
+    auto ks = kernels_here();
+    if(ks.size() == 1){
+        GTEST_SKIP() << "No vector kernel on this CPU";
+    }
+    std::mt19937_64 rng(5);
+    // Around the 4 and 8 lane widths, the 64 bit mask words, and the usual sizes.
+    std::vector<size_t> sizes = {1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 63, 64, 65, 100, 127, 129, 255, 256, 257};
+    for(size_t k: sizes){
+        for(int round = 0; round < 200; round++){
+            std::vector<LL> load(k);
+            // Few distinct loads, so ties are common.
+            LL spread = round % 2 ? 3 : 100000;
+            for(LL & l: load){
+                l = rng() % spread;
+            }
+            PartSet u, v;
+            for(size_t j = 0; j < std::min<size_t>(k, 6); j++){
+                u.insert(rng() % k);
+                v.insert(rng() % k);
+            }
+            ScoreParams sp;
+            sp.wu = 1 + (rng() % 100) / 100.0;
+            sp.wv = 1 + (rng() % 100) / 100.0;
+            sp.lambda = 1.0;
+            sp.epsilon = 1.0;
+            sp.max_size = *std::max_element(load.begin(), load.end());
+            sp.min_size = *std::min_element(load.begin(), load.end());
+            P want = argmax_reference(sp, load, u, v);
+            for(auto && kn: ks){
+                ASSERT_EQ(kn.second(sp, load.data(), u, v, k), want) << kn.first << " k " << k << " round " << round;
+            }
+        }
+    }
+}
+
+TEST(ScoreKernel, DispatchedKernelMatchesScalar){
+    std::vector<LL> load = {5, 3, 3, 9, 3, 1, 1, 2, 8, 1, 1};
+    PartSet u, v;
+    u.insert(3);
+    v.insert(10);
+    ScoreParams sp{1.0, 1.0, 1.0, 1.0, 9, 1};
+    EXPECT_EQ(score_argmax(sp, load.data(), u, v, load.size()), argmax_reference(sp, load, u, v));
+    EXPECT_EQ(score_argmax_fallback(sp, load.data(), u, v, load.size()), argmax_reference(sp, load, u, v));
+}
@@ -0,0 +1,101 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+
+#include <gtest/gtest.h>
+#include "spsc_ring.h"
+#include "partition_def.h"
+#include <vector>
+
+TEST(SpscRing, RoundsUpToPowerOfTwo){
+    SpscRing<int> r;
+    r.init(5);
+    EXPECT_EQ(r.capacity(), 8);
+    r.init(8);
+    EXPECT_EQ(r.capacity(), 8);
+}
+
+TEST(SpscRing, FullRingRefusesUntilDrained){
+    SpscRing<int> r;
+    r.init(4);
+    for(int i = 0; i < 4; i++){
+        EXPECT_TRUE(r.try_push(i));
+    }
+    EXPECT_FALSE(r.try_push(4));
+    EXPECT_EQ(r.size(), 4);
+    std::vector<int> got;
+    EXPECT_EQ(r.drain(3, [&](int x){ got.push_back(x); }), 3);
+    EXPECT_EQ(got, (std::vector<int>{0, 1, 2}));
+    EXPECT_TRUE(r.try_push(4));
+    EXPECT_TRUE(r.try_push(5));
+    EXPECT_TRUE(r.try_push(6));
+    EXPECT_FALSE(r.try_push(7));
+}
+
+TEST(SpscRing, WrapsAroundManyTimes){
+    // Items need not be default constructible.
+    SpscRing<std::pair<P, Edge>> r;
+    r.init(8);
+    LL next = 0, expect = 0;
+    for(int round = 0; round < 1000; round++){
+        // Odd counts, so head and tail land on every slot.
+        for(int i = 0; i < 5 && r.try_push(std::make_pair(next, Edge{next, next + 1})); i++){
+            next++;
+        }
+        r.drain(3, [&](const std::pair<P, Edge> & pr){
+            EXPECT_EQ(pr.first, expect);
+            EXPECT_EQ(pr.second.u, expect);
+            expect++;
+        });
+    }
+    // A drain may stop at the head it last saw, so drain until it finds nothing.
+    while(r.drain(r.capacity(), [&](const std::pair<P, Edge> & pr){
+        EXPECT_EQ(pr.first, expect);
+        expect++;
+    })){
+    }
+    EXPECT_EQ(expect, next);
+    EXPECT_TRUE(r.empty());
+}
+
+TEST(SpscRing, PushWaitsForConsumer){
+    SpscRing<LL> r;
+    r.init(16);
+    const LL N = 200000;
+    std::thread producer([&](){
+        for(LL i = 0; i < N; i++){
+            r.push(i);
+        }
+    });
+    LL expect = 0;
+    size_t most = 0;
+    while(expect < N){
+        most = std::max(most, r.size());
+        if(!r.drain(7, [&](LL x){
+            ASSERT_EQ(x, expect);
+            expect++;
+        })){
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    EXPECT_LE(most, r.capacity());
+    EXPECT_TRUE(r.empty());
+}
@@ -0,0 +1,102 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+
+#include "test_util.h"
+#include "state_local.h"
+
+TEST(PartitionStateLocal, DenseIdsKeepRawIdsOutside){
+    // Sparse, wide ids, so any mixup of raw and dense ids shows.
+    std::vector<Edge> es = {
+        Edge{1ll << 40, 3}, Edge{3, 987654321012ll}, Edge{1ll << 40, 987654321012ll}, Edge{5, 1ll << 33},
+    };
+    DebugStruct ds;
+    PartitionStateLocal st(test_config(write_text_edges("dense.txt", es), 4, ds));
+    EXPECT_EQ(st.verts_size(), 5);
+
+    Map<V, Vertex> delta;
+    delta[1ll << 40].delta_deg = 2;
+    delta[1ll << 40].add_part(1);
+    delta[987654321012ll].delta_deg = 1;
+    delta[987654321012ll].add_part(3);
+    st.put_verts(delta);
+
+    Map<V, Vertex> all = st.get_verts();
+    std::set<V> keys;
+    for(auto && pr: all){
+        keys.insert(pr.first);
+    }
+    EXPECT_EQ(keys, (std::set<V>{3, 5, 1ll << 33, 1ll << 40, 987654321012ll}));
+    EXPECT_EQ(all[1ll << 40].deg.load(), 2);
+    EXPECT_TRUE(all[1ll << 40].parts.contains(1));
+    EXPECT_EQ(all[987654321012ll].deg.load(), 1);
+    EXPECT_TRUE(all[987654321012ll].parts.contains(3));
+    EXPECT_EQ(all[3].deg.load(), 0);
+    EXPECT_TRUE(all[3].parts.empty());
+
+    Map<V, Vertex> some = st.get_verts(Set<V>{3, 1ll << 40});
+    EXPECT_EQ(some.size(), 2);
+    EXPECT_EQ(some[1ll << 40].deg.load(), 2);
+}
+
+TEST(PartitionStateLocal, ParallelRecoverMatchesSequential){
+    std::vector<Edge> es = random_edges(5000, 700, 21);
+    std::string path = write_text_edges("recover.txt", es);
+    std::mt19937_64 rng(22);
+    std::vector<Partition> parts(5);
+    std::map<V, LL> deg;
+    std::map<V, std::set<P>> related;
+    for(const Edge & e: es){
+        P i = rng() % 5;
+        parts[i].add_edge(e);
+        deg[e.u]++;
+        deg[e.v]++;
+        related[e.u].insert(i);
+        related[e.v].insert(i);
+    }
+    std::mutex m;
+    // Thread and stripe counts that split neither the edges nor the partitions evenly.
+    for(int threads: {1, 3, 4}){
+        DebugStruct ds;
+        PartitionConfig c = test_config(path, 5, ds);
+        c.stripes = 7;
+        c.recover_threads = threads;
+        PartitionStateLocal st(c);
+        {
+            std::lock_guard<std::mutex> guard((m));
+            st.recover(guard, parts);
+        }
+        PartitionLoads loads = st.get_loads();
+        for(P i = 0; i < 5; i++){
+            EXPECT_EQ(loads.load[i], parts[i].edges.size()) << threads << " threads";
+        }
+        Map<V, Vertex> verts = st.get_verts();
+        EXPECT_EQ(verts.size(), deg.size());
+        for(auto && pr: deg){
+            Vertex & vert = verts[pr.first];
+            EXPECT_EQ(vert.deg.load(), pr.second) << threads << " threads, vertex " << pr.first;
+            std::set<P> got;
+            for(P p: vert.parts){
+                got.insert(p);
+            }
+            EXPECT_EQ(got, related[pr.first]) << threads << " threads, vertex " << pr.first;
+        }
+    }
+}
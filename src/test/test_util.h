@@ -0,0 +1,68 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+
+#pragma once
+#include <gtest/gtest.h>
+#include "partition_def.h"
+#include <string>
+#include <cstdio>
+#include <random>
+
+// Helpers shared by the tests.
+
+inline std::string test_path(const std::string & name){
+    return testing::TempDir() + "nucut_" + name;
+}
+
+inline std::string write_text_edges(const std::string & name, const std::vector<Edge> & es){
+    std::string path = test_path(name);
+    FILE * f = std::fopen(path.c_str(), "w");
+    for(const Edge & e: es){
+        std::fprintf(f, "%lld %lld\n", e.u, e.v);
+    }
+    std::fclose(f);
+    return path;
+}
+
+inline std::vector<Edge> random_edges(size_t n, V verts, uint64_t seed){
+    // Distinct, no self-loops, in no particular order.
+    std::mt19937_64 rng(seed);
+    std::set<Edge> seen;
+    std::vector<Edge> es;
+    while(es.size() < n){
+        V u = rng() % verts, v = rng() % verts;
+        if(u != v && seen.insert(Edge{u, v}).second){
+            es.push_back(Edge{u, v});
+        }
+    }
+    return es;
+}
+
+inline PartitionConfig test_config(const std::string & dataset, int k, DebugStruct & ds){
+    PartitionConfig c;
+    c.k = k;
+    c.window = 100;
+    c.subp = 1;
+    c.dataset = dataset;
+    c.state = nullptr;
+    c.ds = &ds;
+    return c;
+}
@@ -0,0 +1,86 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+
+#include <gtest/gtest.h>
+#include "varint.h"
+#include <random>
+
+TEST(Varint, RoundTripsBoundaries){
+    std::vector<uint64_t> xs = {0, 1, 127, 128, 255, 16383, 16384, (1ull << 32) - 1, 1ull << 63, ~0ull};
+    std::string s;
+    for(uint64_t x: xs){
+        Varint::put(s, x);
+    }
+    const char * p = s.data(), * end = p + s.size();
+    for(uint64_t x: xs){
+        EXPECT_EQ(Varint::get(p, end), x);
+    }
+    EXPECT_EQ(p, end);
+}
+
+TEST(Varint, EncodedLength){
+    std::string s;
+    Varint::put(s, 127);
+    EXPECT_EQ(s.size(), 1);
+    s.clear();
+    Varint::put(s, 128);
+    EXPECT_EQ(s.size(), 2);
+    s.clear();
+    Varint::put(s, ~0ull);
+    EXPECT_EQ(s.size(), 10);
+    // Small vertices of either sign stay short.
+    s.clear();
+    Varint::put_vert(s, -1);
+    EXPECT_EQ(s.size(), 1);
+}
+
+TEST(Varint, VertsAndEdges){
+    std::mt19937_64 rng(11);
+    std::vector<V> vs = {0, -1, 1, std::numeric_limits<V>::max(), std::numeric_limits<V>::min()};
+    for(int i = 0; i < 1000; i++){
+        vs.push_back((V)rng() >> (rng() % 64));
+    }
+    std::string s;
+    for(V v: vs){
+        Varint::put_vert(s, v);
+    }
+    std::vector<Edge> es;
+    for(size_t i = 0; i + 1 < vs.size(); i++){
+        es.push_back(Edge{vs[i], vs[i + 1]});
+        Varint::put_edge(s, es.back());
+    }
+    const char * p = s.data(), * end = p + s.size();
+    for(V v: vs){
+        EXPECT_EQ(Varint::get_vert(p, end), v);
+    }
+    for(const Edge & e: es){
+        EXPECT_EQ(Varint::get_edge(p, end), e);
+    }
+    EXPECT_EQ(p, end);
+}
+
+TEST(Varint, TruncatedInputStopsAtEnd){
+    std::string s;
+    Varint::put(s, 1ull << 40);
+    const char * p = s.data(), * end = p + 2;
+    Varint::get(p, end);
+    EXPECT_EQ(p, end);
+}
@@ -0,0 +1,157 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+
+#include "test_util.h"
+#include "state_local.h"
+#include "wal.h"
+
+static std::set<Edge> edge_set(const Partition & p){
+    std::set<Edge> res;
+    for(const Edge & e: p.edges){
+        res.insert(e);
+    }
+    return res;
+}
+
+static Partition make_part(const std::vector<Edge> & es, size_t from, size_t to){
+    Partition p;
+    for(size_t j = from; j < to; j++){
+        p.add_edge(es[j]);
+    }
+    return p;
+}
+
+TEST(EdgeLog, ReplaysAppendedRecords){
+    std::string path = test_path("replay.wal");
+    std::remove(path.c_str());
+    std::vector<Edge> es = random_edges(1000, 300, 11);
+    {
+        std::vector<Partition> old;
+        EdgeLog log(path, 2, 64, old);
+        ASSERT_EQ(old.size(), 2);
+        EXPECT_TRUE(old[0].edges.empty() && old[1].edges.empty());
+        log.append(0, make_part(es, 0, 400));
+        log.append(1, make_part(es, 400, 1000));
+        log.append(1, Partition());
+        EXPECT_TRUE(log.sync());
+    }
+    std::vector<Partition> got;
+    ASSERT_TRUE(EdgeLog::replay(path, got));
+    ASSERT_EQ(got.size(), 2);
+    EXPECT_EQ(edge_set(got[0]), edge_set(make_part(es, 0, 400)));
+    EXPECT_EQ(edge_set(got[1]), edge_set(make_part(es, 400, 1000)));
+}
+
+TEST(EdgeLog, RestartDropsTornTailAndAppends){
+    std::string path = test_path("torn.wal");
+    std::remove(path.c_str());
+    std::vector<Edge> es = random_edges(300, 100, 12);
+    {
+        std::vector<Partition> old;
+        EdgeLog log(path, 2, 1 << 16, old);
+        log.append(0, make_part(es, 0, 100));
+        log.append(1, make_part(es, 100, 200));
+    }
+    // A crash in the middle of a record leaves its header and part of its payload.
+    std::string rec;
+    EdgeLog::put_record(rec, 0, make_part(es, 200, 250).edges, 0, 50);
+    FILE * f = std::fopen(path.c_str(), "ab");
+    std::fwrite(rec.data(), 1, rec.size() / 2, f);
+    std::fclose(f);
+
+    std::vector<Partition> got;
+    ASSERT_TRUE(EdgeLog::replay(path, got));
+    EXPECT_EQ(got[0].edges.size() + got[1].edges.size(), 200);
+    {
+        std::vector<Partition> old;
+        EdgeLog log(path, 2, 1 << 16, old);
+        EXPECT_EQ(edge_set(old[0]), edge_set(make_part(es, 0, 100)));
+        EXPECT_EQ(edge_set(old[1]), edge_set(make_part(es, 100, 200)));
+        // Had the torn record stayed, this one would sit behind it and be lost.
+        log.append(0, make_part(es, 250, 300));
+    }
+    ASSERT_TRUE(EdgeLog::replay(path, got));
+    Partition want = make_part(es, 0, 100);
+    for(size_t j = 250; j < 300; j++){
+        want.add_edge(es[j]);
+    }
+    EXPECT_EQ(edge_set(got[0]), edge_set(want));
+    EXPECT_EQ(edge_set(got[1]), edge_set(make_part(es, 100, 200)));
+    EXPECT_NE(access((path + ".tmp").c_str(), F_OK), 0);
+}
+
+TEST(PartitionStateLocal, ResumesFromWal){
+    std::string path = test_path("resume.wal");
+    std::remove(path.c_str());
+    std::vector<Edge> es = random_edges(2000, 400, 13);
+    DebugStruct ds;
+    PartitionConfig c = test_config(write_text_edges("resume.txt", es), 3, ds);
+    c.crash_mode = 1;
+    c.wal = path;
+    // The first run commits some edges out of stream order, then stops.
+    std::vector<std::set<Edge>> want(3);
+    std::set<Edge> left(es.begin(), es.end());
+    {
+        PartitionStateLocal st(c);
+        std::vector<Partition> delta(3);
+        for(size_t j = 0; j < es.size(); j += 3){
+            delta[j % 2].add_edge(es[j]);
+            want[j % 2].insert(es[j]);
+            left.erase(es[j]);
+        }
+        st.put_parts(delta);
+        st.sync();
+    }
+    PartitionStateLocal st(c);
+    std::vector<Partition> parts = st.get_parts();
+    PartitionLoads loads = st.get_loads();
+    std::map<V, LL> deg;
+    for(P i = 0; i < 3; i++){
+        EXPECT_EQ(edge_set(parts[i]), want[i]);
+        EXPECT_EQ(loads.load[i], want[i].size());
+        for(const Edge & e: want[i]){
+            deg[e.u]++;
+            deg[e.v]++;
+        }
+    }
+    Map<V, Vertex> verts = st.get_verts();
+    for(auto && pr: deg){
+        EXPECT_EQ(verts[pr.first].deg.load(), pr.second);
+    }
+    // Only what the WAL does not hold is dispensed again.
+    std::vector<Edge> batch;
+    while(st.get_edges(64, batch)){
+    }
+    EXPECT_EQ(std::set<Edge>(batch.begin(), batch.end()), left);
+    EXPECT_EQ(batch.size(), left.size());
+}
+
+TEST(EdgeLogDeathTest, RefusesOtherK){
+    testing::FLAGS_gtest_death_test_style = "threadsafe";
+    std::string path = test_path("k.wal");
+    std::remove(path.c_str());
+    {
+        std::vector<Partition> old;
+        EdgeLog log(path, 2, 64, old);
+    }
+    std::vector<Partition> old;
+    EXPECT_DEATH(EdgeLog(path, 3, 64, old), "k = 2");
+}
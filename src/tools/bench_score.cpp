@@ -0,0 +1,70 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+
+// Times every scoring kernel this CPU has, see score_kernel.h.
+// Usage: ./bench_score [k] [calls]
+
+#include "score_kernel.h"
+#include <random>
+
+int main(int argc, char ** argv){
+    size_t k = argc > 1 ? std::atoi(argv[1]) : 256;
+    int calls = argc > 2 ? std::atoi(argv[2]) : 200000;
+    std::mt19937_64 rng(1);
+    std::vector<LL> load(k);
+    for(LL & l: load){
+        l = rng() % 100000;
+    }
+    PartSet u, v;
+    for(int j = 0; j < 3; j++){
+        u.insert(rng() % k);
+        v.insert(rng() % k);
+    }
+    ScoreParams sp{1.5, 1.5, 1.0, 1.0, 100000, 0};
+
+    std::vector<std::pair<const char *, ScoreKernel>> kernels{{"scalar", score_argmax_fallback}};
+    #if defined(NUCUT_X86_KERNELS)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        kernels.push_back({"avx2", score_argmax_avx2});
+    }
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")){
+        kernels.push_back({"avx512", score_argmax_avx512});
+    }
+    #endif
+    double base = 0;
+    for(auto && kn: kernels){
+        std::vector<LL> l = load;
+        LL acc = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < calls; i++){
+            // Loads move between calls, as they do while partitioning.
+            l[i % k]++;
+            acc += kn.second(sp, l.data(), u, v, k);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+        if(!base){
+            base = ns;
+        }
+        printf("%-8s k %zu %8.1f ns/call %5.2fx (checksum %lld)\n", kn.first, k, ns, base / ns, acc);
+    }
+    return 0;
+}
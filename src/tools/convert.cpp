@@ -0,0 +1,45 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+// Converts a "u v" text edge list into the binary edge list read by EdgeStore,
+// or a binary edge list back into text.
+// Usage: ./convert <input.txt> <output.bin>
+//        ./convert <input.bin> <output.txt>
+
+#include "edge_store.h"
+
+int main(int argc, char ** argv){
+    if(argc != 3){
+        fprintf(stderr, "Usage: %s <input.txt> <output.bin>\n       %s <input.bin> <output.txt>\n", argv[0], argv[0]);
+        return 1;
+    }
+    EdgeStore edges;
+    bool to_text = EdgeStore::is_binary(argv[1]);
+    if(!edges.load(argv[1])){
+        fprintf(stderr, "Can't read %s\n", argv[1]);
+        return 1;
+    }
+    if(!(to_text ? edges.write_text(argv[2]) : edges.write_binary(argv[2]))){
+        fprintf(stderr, "Can't write %s\n", argv[2]);
+        return 1;
+    }
+    printf("Edges %u\n", edges.size());
+    return 0;
+}
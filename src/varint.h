@@ -0,0 +1,63 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#pragma once
+#include "partition_def.h"
+#include <string>
+
+// LEB128 varints, shared by the compact on-wire and on-disk edge formats.
+// A vertex packs as a zigzag varint, an edge as u followed by v - u,
+// which is small since edges are normalized to u <= v.
+namespace Varint{
+inline void put(std::string & s, uint64_t x){
+    while(x >= 0x80){
+        s.push_back((char)(x | 0x80));
+        x >>= 7;
+    }
+    s.push_back((char)x);
+}
+inline uint64_t get(const char * & p, const char * end){
+    uint64_t x = 0;
+    for(int shift = 0; p < end && shift < 64; shift += 7){
+        uint8_t b = *p++;
+        x |= (uint64_t)(b & 0x7f) << shift;
+        if(!(b & 0x80)){
+            break;
+        }
+    }
+    return x;
+}
+inline void put_vert(std::string & s, V v){
+    put(s, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+inline V get_vert(const char * & p, const char * end){
+    uint64_t z = get(p, end);
+    return (V)((z >> 1) ^ -(z & 1));
+}
+inline void put_edge(std::string & s, const Edge & e){
+    put_vert(s, e.u);
+    put(s, (uint64_t)e.v - (uint64_t)e.u);
+}
+inline Edge get_edge(const char * & p, const char * end){
+    V u = get_vert(p, end);
+    V v = (V)((uint64_t)u + get(p, end));
+    return Edge{u, v};
+}
+};
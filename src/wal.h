@@ -0,0 +1,270 @@
+/*************************************************************************
+*  NuCut -- A streaming graph partitioning framework
+*  Copyright (C) 2018  Calvin Neo 
+*  Email: calvinneo@calvinneo.com;calvinneo1995@gmail.com
+*  Github: https://github.com/CalvinNeo/NuCut/
+*  
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*  
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*  
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**************************************************************************/
+
+#pragma once
+#include "partition_def.h"
+#include "varint.h"
+#include <string>
+#include <deque>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Write-ahead log of committed edges, for crash recovery without the kv replica.
+// A 16 byte header, then one record per committed delta:
+//   uint32 len, uint32 checksum (FNV-1a of the payload), uint32 partition, uint32 count,
+//   followed by `len` bytes of `count` edges packed as in Varint.
+// Replay stops at the first torn or corrupt record, which can only be the tail.
+// A log found at startup is replayed and rewritten as a checkpoint before anything
+// is appended, so a torn tail never ends up in the middle of the log.
+static const char WAL_MAGIC[8] = {'N', 'U', 'C', 'U', 'T', 'W', 'L', '\0'};
+static const uint32_t WAL_VERSION = 1;
+
+struct WalFileHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t k;
+};
+
+struct WalRecordHeader{
+    uint32_t len;
+    uint32_t checksum;
+    uint32_t part;
+    uint32_t count;
+};
+static_assert(sizeof(WalFileHeader) == 16, "Unexpected WalFileHeader layout");
+static_assert(sizeof(WalRecordHeader) == 16, "Unexpected WalRecordHeader layout");
+
+inline uint32_t wal_checksum(const char * p, size_t n){
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < n; i++){
+        h = (h ^ (uint8_t)p[i]) * 16777619u;
+    }
+    return h;
+}
+
+inline bool wal_write(int fd, const std::string & out){
+    for(size_t off = 0; off < out.size(); ){
+        ssize_t w = ::write(fd, out.data() + off, out.size() - off);
+        if(w < 0 && errno == EINTR){
+            continue;
+        }
+        if(w <= 0){
+            return false;
+        }
+        off += w;
+    }
+    return true;
+}
+
+struct EdgeLog{
+    // Committers append records to an in-memory tail and return. A flusher thread
+    // writes the tail out and fdatasyncs it, so every record that arrived during one
+    // fdatasync shares the next one (group commit). Once max_lag edges are waiting,
+    // append() blocks. sync() waits until everything appended so far is on disk.
+    std::string path;
+    int fd = -1;
+    std::mutex mut;
+    std::condition_variable cv;
+    std::string tail;
+    size_t lag = 0;
+    size_t max_lag;
+    uint64_t appended = 0, durable = 0;
+    uint64_t syncs = 0;
+    bool failed = false;
+    bool stop = false;
+    std::thread * th = nullptr;
+
+    // Edges of one checkpointed record at most, so len stays far below 4 GB.
+    static const size_t CHECKPOINT_RECORD = 1 << 20;
+
+    EdgeLog(const std::string & p, int k, size_t lag_, std::vector<Partition> & recovered) : path(p), max_lag(std::max<size_t>(1, lag_)){
+        // Whatever an earlier run left in the log comes back in `recovered`, and the
+        // log is checkpointed to exactly that before this run appends to it.
+        struct stat st;
+        if(::stat(path.c_str(), &st) == 0 && st.st_size > 0){
+            if(!replay(path, recovered)){
+                LOG_FATAL("%s is not a WAL of version %u\n", path.c_str(), WAL_VERSION);
+            }
+            if(recovered.size() != k){
+                LOG_FATAL("WAL %s was written with k = %zu, not %d\n", path.c_str(), recovered.size(), k);
+            }
+        }else{
+            recovered.clear();
+            recovered.resize(k);
+        }
+        if(!checkpoint(path, recovered)){
+            LOG_FATAL("Can't checkpoint WAL %s: %s\n", path.c_str(), strerror(errno));
+        }
+        fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+        if(fd < 0){
+            LOG_FATAL("Can't open WAL %s: %s\n", path.c_str(), strerror(errno));
+        }
+        th = new std::thread(&EdgeLog::main_proc, this);
+    }
+    EdgeLog(const EdgeLog &) = delete;
+    EdgeLog & operator=(const EdgeLog &) = delete;
+    ~EdgeLog(){
+        {
+            std::lock_guard<std::mutex> guard((mut));
+            stop = true;
+        }
+        cv.notify_all();
+        th->join();
+        delete th;
+        LOG_INFO("WAL %llu bytes in %llu fdatasyncs\n", (unsigned long long)durable, (unsigned long long)syncs);
+        ::close(fd);
+    }
+
+    void append(P i, const Partition & delta){
+        size_t n = delta.edges.size();
+        if(!n){
+            return;
+        }
+        // Encoded before taking the lock.
+        std::string rec;
+        put_record(rec, i, delta.edges, 0, n);
+        std::unique_lock<std::mutex> lk((mut));
+        cv.wait(lk, [&](){ return lag == 0 || lag + n <= max_lag || failed; });
+        tail += rec;
+        lag += n;
+        appended += rec.size();
+        cv.notify_all();
+    }
+    bool sync(){
+        std::unique_lock<std::mutex> lk((mut));
+        uint64_t target = appended;
+        cv.wait(lk, [&](){ return durable >= target || failed; });
+        return !failed;
+    }
+    void main_proc(){
+        std::string out;
+        while(1){
+            size_t n;
+            {
+                std::unique_lock<std::mutex> lk((mut));
+                cv.wait(lk, [&](){ return stop || !tail.empty(); });
+                if(tail.empty()){
+                    return;
+                }
+                out.swap(tail);
+                tail.clear();
+                n = lag;
+            }
+            bool ok = wal_write(fd, out) && fdatasync(fd) == 0;
+            std::lock_guard<std::mutex> guard((mut));
+            if(!ok){
+                LOG_ERROR("WAL write to %s failed: %s\n", path.c_str(), strerror(errno));
+                failed = true;
+            }
+            durable += out.size();
+            lag -= n;
+            syncs++;
+            cv.notify_all();
+        }
+    }
+
+    static void put_record(std::string & out, P i, const EdgeColumns & es, size_t from, size_t to){
+        size_t at = out.size();
+        out.resize(at + sizeof(WalRecordHeader));
+        for(size_t j = from; j < to; j++){
+            Varint::put_edge(out, es[j]);
+        }
+        WalRecordHeader h;
+        h.len = out.size() - at - sizeof h;
+        h.checksum = wal_checksum(out.data() + at + sizeof h, h.len);
+        h.part = i;
+        h.count = to - from;
+        std::memcpy(&out[at], &h, sizeof h);
+    }
+    static bool checkpoint(const std::string & path, const std::vector<Partition> & parts){
+        // Writes a log holding just `parts` next to path and renames it over path,
+        // so path is either the old log or the whole new one, never a mix.
+        std::string tmp = path + ".tmp";
+        int out = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(out < 0){
+            return false;
+        }
+        WalFileHeader fh;
+        std::memcpy(fh.magic, WAL_MAGIC, sizeof fh.magic);
+        fh.version = WAL_VERSION;
+        fh.k = parts.size();
+        std::string buf((const char *)&fh, sizeof fh);
+        bool ok = true;
+        for(P i = 0; i < (P)parts.size() && ok; i++){
+            const EdgeColumns & es = parts[i].edges;
+            for(size_t j = 0; j < es.size() && ok; j += CHECKPOINT_RECORD){
+                put_record(buf, i, es, j, std::min(es.size(), j + CHECKPOINT_RECORD));
+                ok = wal_write(out, buf);
+                buf.clear();
+            }
+        }
+        ok = ok && wal_write(out, buf) && fdatasync(out) == 0;
+        ::close(out);
+        ok = ok && ::rename(tmp.c_str(), path.c_str()) == 0;
+        if(ok){
+            // The rename is durable once the directory is.
+            size_t slash = path.find_last_of('/');
+            std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+            int dfd = ::open(dir.c_str(), O_RDONLY);
+            ok = dfd >= 0 && fsync(dfd) == 0;
+            if(dfd >= 0){
+                ::close(dfd);
+            }
+        }
+        return ok;
+    }
+
+    static bool replay(const std::string & path, std::vector<Partition> & parts){
+        // Rebuilds the partitions from a log, returns false if it is not one.
+        FILE * f = std::fopen(path.c_str(), "rb");
+        if(!f){
+            return false;
+        }
+        WalFileHeader fh;
+        if(std::fread(&fh, sizeof fh, 1, f) != 1 || std::memcmp(fh.magic, WAL_MAGIC, sizeof fh.magic) != 0
+                || fh.version != WAL_VERSION){
+            std::fclose(f);
+            return false;
+        }
+        parts.clear();
+        parts.resize(fh.k);
+        WalRecordHeader h;
+        std::string payload;
+        size_t records = 0;
+        while(std::fread(&h, sizeof h, 1, f) == 1){
+            payload.resize(h.len);
+            if(h.part >= fh.k || (h.len && std::fread(&payload[0], 1, h.len, f) != h.len)
+                    || wal_checksum(payload.data(), h.len) != h.checksum){
+                LOG_WARN("WAL %s ends with a torn record after %zu records\n", path.c_str(), records);
+                break;
+            }
+            const char * p = payload.data(), * end = p + payload.size();
+            for(uint32_t j = 0; j < h.count; j++){
+                parts[h.part].add_edge(Varint::get_edge(p, end));
+            }
+            records++;
+        }
+        std::fclose(f);
+        return true;
+    }
+};